@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <sched.h>
+
+#include "arena.h"
+
+#define ARENA_MAX_CLASS (ARENA_CLASSES - 1)
+#define ARENA_LOCK_SPINS 64         // spins before yielding the CPU to whoever holds the lock
+
+static arena_block_t* arena_block(arena_t *arena, uint32_t block)
+{
+    return (arena_block_t *)((char *)arena + block);
+}
+
+static void arena_lock(arena_t *arena)
+{
+    unsigned int spins = 0;
+
+    while (atomic_exchange_explicit(&arena->lock, 1, memory_order_acquire)) {
+        while (atomic_load_explicit(&arena->lock, memory_order_relaxed)) {
+            if (++spins < ARENA_LOCK_SPINS)
+                cpu_relax();
+            else
+                sched_yield();
+        }
+    }
+}
+
+static void arena_unlock(arena_t *arena)
+{
+    atomic_store_explicit(&arena->lock, 0, memory_order_release);
+}
+
+/**
+ * @brief Put a block on the free list of class c, the lock held
+ */
+static void arena_push(arena_t *arena, uint32_t block, int c)
+{
+    arena_block_t *b = arena_block(arena, block);
+
+    b->size_class = c;
+    b->free = 1;
+    b->prev = ARENA_NONE;
+    b->next = arena->free[c];
+    if (b->next != ARENA_NONE)
+        arena_block(arena, b->next)->prev = block;
+    arena->free[c] = block;
+}
+
+/**
+ * @brief Take a block off the free list it is on, the lock held
+ */
+static void arena_unlink(arena_t *arena, uint32_t block)
+{
+    arena_block_t *b = arena_block(arena, block);
+
+    if (b->prev != ARENA_NONE)
+        arena_block(arena, b->prev)->next = b->next;
+    else
+        arena->free[b->size_class] = b->next;
+    if (b->next != ARENA_NONE)
+        arena_block(arena, b->next)->prev = b->prev;
+    b->free = 0;
+}
+
+/**
+ * @brief Set up an empty arena of size bytes, header included, in memory the caller has mapped
+ *
+ * The space after the header is cut into blocks of the largest class, whatever is left over is not used.
+ */
+void arena_init(arena_t *arena, size_t size)
+{
+    unsigned long block_size = (unsigned long)ARENA_MIN_BLOCK << ARENA_MAX_CLASS;
+
+    arena->base = (sizeof(arena_t) + ARENA_MIN_BLOCK - 1) & ~(unsigned long)(ARENA_MIN_BLOCK - 1);
+    arena->size = size;
+    atomic_store_explicit(&arena->lock, 0, memory_order_relaxed);
+    for (int c = 0; c < ARENA_CLASSES; ++c) {
+        arena->free[c] = ARENA_NONE;
+        arena->allocated[c] = 0;
+    }
+    arena->used = 0;
+    arena->splits = 0;
+    arena->merges = 0;
+    atomic_store_explicit(&arena->freed, 0, memory_order_relaxed);
+
+    // Pushed from the end, so the first allocations come from the start of the arena
+    for (unsigned long count = (size - arena->base) / block_size; count > 0; --count)
+        arena_push(arena, arena->base + (count - 1) * block_size, ARENA_MAX_CLASS);
+}
+
+/**
+ * @brief Smallest class whose blocks hold size bytes after the block header, -1 if none does
+ */
+static int arena_class(size_t size)
+{
+    int c = 0;
+
+    while (c < ARENA_CLASSES && (size_t)ARENA_MIN_BLOCK << c < size + sizeof(arena_block_t))
+        c++;
+    return c < ARENA_CLASSES ? c : -1;
+}
+
+/**
+ * @brief A block for at least size bytes, split off the smallest free block that holds it
+ *
+ * @return uint32_t
+ * Return the block's handle, ARENA_NONE if the arena has none to spare right now
+ */
+uint32_t arena_alloc(arena_t *arena, size_t size)
+{
+    int c = arena_class(size), k;
+    uint32_t block;
+
+    if (c < 0)
+        return ARENA_NONE;
+
+    arena_lock(arena);
+    for (k = c; k < ARENA_CLASSES && arena->free[k] == ARENA_NONE; ++k)
+        ;
+    if (k == ARENA_CLASSES) {
+        arena_unlock(arena);
+        return ARENA_NONE;
+    }
+    block = arena->free[k];
+    arena_unlink(arena, block);
+
+    // Keep the lower half each time, the upper one goes on the free list a class down
+    while (k > c) {
+        k--;
+        arena_push(arena, block + (ARENA_MIN_BLOCK << k), k);
+        arena->splits++;
+    }
+    arena_block(arena, block)->size_class = c;
+    arena->used += ARENA_MIN_BLOCK << c;
+    arena->allocated[c]++;
+    arena_unlock(arena);
+    return block;
+}
+
+/**
+ * @brief arena_alloc(), blocking until another process frees a block while the arena is exhausted
+ *
+ * @param sleeps Incremented for every time it slept
+ * @return uint32_t
+ * Return the block's handle, ARENA_NONE if size is larger than any block or the arena could never hold it
+ */
+uint32_t arena_alloc_wait(arena_t *arena, size_t size, unsigned int spin_budget, uint64_t *sleeps)
+{
+    for (;;) {
+        // Read before trying, a block freed after the failed try moves it and ends the wait
+        unsigned long freed = atomic_load_explicit(&arena->freed, memory_order_acquire);
+        uint32_t block = arena_alloc(arena, size);
+
+        if (block != ARENA_NONE || arena_class(size) < 0)
+            return block;
+        // Nothing is out to be freed, waiting would be forever
+        arena_lock(arena);
+        unsigned long used = arena->used;
+        arena_unlock(arena);
+        if (used == 0)
+            return ARENA_NONE;
+        *sleeps += wait_while_equal(&arena->freed, freed, &arena->space, WAIT_FUTEX, spin_budget);
+    }
+}
+
+/**
+ * @brief Give a block back from whichever process holds it, merged with its buddy for as long as that is free
+ */
+void arena_free(arena_t *arena, uint32_t block)
+{
+    int c;
+
+    arena_lock(arena);
+    c = arena_block(arena, block)->size_class;
+    arena->used -= ARENA_MIN_BLOCK << c;
+    while (c < ARENA_MAX_CLASS) {
+        uint32_t buddy = arena->base + ((block - arena->base) ^ (ARENA_MIN_BLOCK << c));
+        arena_block_t *b = arena_block(arena, buddy);
+
+        // A buddy split into smaller blocks has the class of its first one
+        if (!b->free || b->size_class != (uint32_t)c)
+            break;
+        arena_unlink(arena, buddy);
+        if (buddy < block)
+            block = buddy;
+        c++;
+        arena->merges++;
+    }
+    arena_push(arena, block, c);
+    arena_unlock(arena);
+
+    atomic_fetch_add_explicit(&arena->freed, 1, memory_order_release);
+    waitpoint_wake(&arena->space);
+}
+
+/**
+ * @brief How much of the arena is handed out and in which classes
+ */
+void arena_stats(arena_t *arena)
+{
+    arena_lock(arena);
+    printf("Arena: %lu of %lu KB in use, %lu splits, %lu merges, blocks per class from %d B:",
+           arena->used >> 10, (arena->size - arena->base) >> 10, arena->splits, arena->merges, ARENA_MIN_BLOCK);
+    for (int c = 0; c < ARENA_CLASSES; ++c)
+        printf(" %lu", arena->allocated[c]);
+    printf("\n");
+    arena_unlock(arena);
+}
@@ -0,0 +1,68 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "mailbox.h"
+
+#define ARENA_MIN_BLOCK 64          // smallest block, blocks of class c are ARENA_MIN_BLOCK << c bytes
+#define ARENA_CLASSES 9             // up to 16 KB, so a whole frame with its block header fits the largest
+#define ARENA_SIZE (4 << 20)        // bytes of the arena segment of mechanism 13
+#define ARENA_HANDLES 1024          // handles in flight on mechanism 13, must be a power of two
+#define ARENA_NONE 0                // no block, offset 0 is the arena header itself
+
+/*
+ * Buddy allocator for a shared segment: the arena starts out as blocks of the largest class,
+ * a request splits the smallest free block that fits in halves down to its class, and a freed
+ * block merges with its buddy whenever that is free too, so large and small requests share the
+ * space without fragmenting it for good.
+ * Blocks are named by their offset from the arena header, which is the same in every process
+ * whatever address it maps the segment at. A spinlock guards the free lists, it is only held
+ * for a few list operations.
+ */
+typedef struct {
+    uint32_t size_class;
+    uint32_t free;                  // on the free list of its class
+    uint32_t next;                  // neighbours on that list while free, ARENA_NONE at the ends
+    uint32_t prev;
+} arena_block_t;
+
+typedef struct {
+    unsigned long base;             // offset of the first block, buddies are paired relative to it
+    unsigned long size;             // bytes from the header to the end of the arena
+    _Alignas(CACHE_LINE_SIZE) atomic_uint lock;
+    uint32_t free[ARENA_CLASSES];   // free list heads
+    unsigned long used;             // bytes in blocks handed out
+    unsigned long allocated[ARENA_CLASSES];   // blocks handed out per class
+    unsigned long splits;
+    unsigned long merges;
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong freed;     // blocks freed, what an allocator waits on
+    _Alignas(CACHE_LINE_SIZE) waitpoint_t space;      // an allocator sleeps here while the arena is exhausted
+} arena_t;
+
+/*
+ * Layout of the shared segment for mechanism 13: an SPSC ring of block handles in front of the arena
+ * the frames are in. Only the handles go through the ring, each frame occupies a block of its size.
+ */
+typedef struct arena_segment {
+    _Alignas(CACHE_LINE_SIZE) atomic_uint magic;   // set to RING_MAGIC once initialized
+    unsigned int spin_budget;                       // sender's spin budget, the receiver's default
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong head;   // next handle the sender writes
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong tail;   // next handle the receiver reads
+    _Alignas(CACHE_LINE_SIZE) waitpoint_t data;    // the receiver sleeps here while no handle is queued
+    _Alignas(CACHE_LINE_SIZE) waitpoint_t space;   // the sender sleeps here while the handle ring is full
+    uint32_t handles[ARENA_HANDLES];
+    _Alignas(CACHE_LINE_SIZE) arena_t arena;       // last, its blocks run to the end of the segment
+} arena_segment_t;
+
+void arena_init(arena_t *arena, size_t size);
+uint32_t arena_alloc(arena_t *arena, size_t size);
+uint32_t arena_alloc_wait(arena_t *arena, size_t size, unsigned int spin_budget, uint64_t *sleeps);
+void arena_free(arena_t *arena, uint32_t block);
+void arena_stats(arena_t *arena);
+
+// Usable bytes of the block at offset block
+static inline void* arena_ptr(arena_t *arena, uint32_t block)
+{
+    return (char *)arena + block + sizeof(arena_block_t);
+}
+
+#endif
@@ -0,0 +1,224 @@
+#include "batch.h"
+#include "rpc.h"
+
+/**
+ * @brief Frame records are appended to, claiming a new one from the transport if none is open
+ */
+static frame_t* open_frame(mailbox_t *mailbox_ptr)
+{
+    batch_t *batch = &mailbox_ptr->batch;
+
+    if (batch->pending != NULL)
+        return batch->pending;
+
+    // A slot of the shared segment for the transports that fill in place, the staging frame otherwise
+    batch->pending = mailbox_ptr->transport->claim(mailbox_ptr);
+    batch->pending->length = 0;
+    batch->pending->count = 0;
+    batch->pending->type = MSG_DATA;
+    batch->pending->priority = batch->priority;
+    return batch->pending;
+}
+
+/**
+ * @brief Move the pending frame to the receiver in one transfer
+ */
+void flush(mailbox_t *mailbox_ptr)
+{
+    frame_t *frame = mailbox_ptr->batch.pending;
+
+    if (frame == NULL || (frame->count == 0 && frame->type == MSG_DATA))
+        return;
+
+    mailbox_ptr->transport->send(mailbox_ptr, frame);
+    mailbox_ptr->batch.pending = NULL;
+}
+
+/**
+ * @brief Send the pending records, then end the stream with a control frame of its own
+ *
+ * The exit frame goes at the lowest priority, so nothing sent before it is overtaken.
+ */
+void finish(mailbox_t *mailbox_ptr)
+{
+    flush(mailbox_ptr);
+    mailbox_ptr->batch.priority = 0;
+    open_frame(mailbox_ptr)->type = MSG_EXIT;
+    flush(mailbox_ptr);
+}
+
+/**
+ * @brief Commit the next messages at priority, a frame only holds records of one priority
+ *
+ * Call it before reserve(), a reservation stays in the frame of the old priority.
+ *
+ * @param priority 0 to PRIORITY_LEVELS - 1, higher is more urgent
+ */
+void set_priority(mailbox_t *mailbox_ptr, unsigned int priority)
+{
+    batch_t *batch = &mailbox_ptr->batch;
+
+    if (priority == batch->priority)
+        return;
+    flush(mailbox_ptr);
+    batch->priority = priority;
+}
+
+/**
+ * @brief Where the payload of the next message goes, at least length bytes
+ *
+ * For the ring this points straight into the shared segment.
+ * length may be only an upper bound: if that much does not fit behind the records already in the frame,
+ * the payload goes to the spill buffer and commit() decides on the real length whether the frame is full.
+ * Nothing is sent until commit(), reserving again just returns the same space.
+ */
+char* reserve(mailbox_t *mailbox_ptr, unsigned short length)
+{
+    batch_t *batch = &mailbox_ptr->batch;
+    frame_t *frame;
+
+    // An RPC client may not have more than its window of requests unanswered
+    if (mailbox_ptr->rpc != NULL)
+        rpc_wait_window(mailbox_ptr);
+
+    frame = open_frame(mailbox_ptr);
+    batch->spilled = frame->length + RECORD_HEADER_SIZE + length > sizeof(frame->data);
+    if (batch->spilled)
+        return batch->spill;
+    return frame->data + frame->length + RECORD_HEADER_SIZE;
+}
+
+/**
+ * @brief Turn the first length bytes written to the last reserve() into a message, numbered in commit order
+ */
+void commit(mailbox_t *mailbox_ptr, unsigned short length)
+{
+    commit_with_id(mailbox_ptr, length, mailbox_ptr->messages);
+}
+
+/**
+ * @brief commit() with the id the record carries given, a reply's is the one of its request
+ */
+void commit_with_id(mailbox_t *mailbox_ptr, unsigned short length, uint64_t id)
+{
+    batch_t *batch = &mailbox_ptr->batch;
+    frame_t *frame = batch->pending;
+
+    // A spilled payload is moved in now that its length is known, to a new frame if it does not fit after all
+    if (batch->spilled) {
+        if (frame->length + RECORD_HEADER_SIZE + length > sizeof(frame->data)) {
+            flush(mailbox_ptr);
+            frame = open_frame(mailbox_ptr);
+        }
+        memcpy(frame->data + frame->length + RECORD_HEADER_SIZE, batch->spill, length);
+        batch->spilled = 0;
+    }
+
+    record_t record = {length, now_ns(), id};
+
+    if (frame->count == 0)
+        clock_gettime(CLOCK_MONOTONIC, &batch->first);
+    if (mailbox_ptr->messages == 0)
+        mailbox_ptr->first_ns = record.stamp;
+    if (mailbox_ptr->rpc != NULL)
+        rpc_track(mailbox_ptr->rpc, &record);
+
+    memcpy(frame->data + frame->length, &record, RECORD_HEADER_SIZE);
+    frame->length += RECORD_HEADER_SIZE + length;
+    frame->count++;
+    mailbox_ptr->messages++;
+    mailbox_ptr->bytes += length;
+
+    // The time threshold is only checked here, a batch never waits for the next send longer than that.
+    // Urgent records never wait for a batch to fill.
+    if (frame->count >= batch->max_count || frame->length >= batch->max_bytes || frame->priority > 0) {
+        flush(mailbox_ptr);
+    } else if (batch->max_delay_ns > 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec - batch->first.tv_sec) * 1000000000L + (now.tv_nsec - batch->first.tv_nsec) >= batch->max_delay_ns)
+            flush(mailbox_ptr);
+    }
+}
+
+/**
+ * @brief Get the next frame from the sender: copied into the staging frame, or the shared slot itself
+ *
+ * @return frame_t*
+ * Return NULL when the transport has nothing left to deliver
+ */
+static frame_t* fetch_frame(mailbox_t *mailbox_ptr)
+{
+    batch_t *batch = &mailbox_ptr->batch;
+    frame_t *frame = mailbox_ptr->transport->recv(mailbox_ptr);
+
+    if (frame == NULL)
+        return NULL;
+
+    batch->pending = frame;
+    batch->offset = 0;
+    return frame;
+}
+
+/**
+ * @brief Done with the pending frame, hand a shared slot back to the sender
+ */
+static void release_frame(mailbox_t *mailbox_ptr)
+{
+    if (mailbox_ptr->transport->release)
+        mailbox_ptr->transport->release(mailbox_ptr, mailbox_ptr->batch.pending);
+    mailbox_ptr->batch.pending = NULL;
+}
+
+/**
+ * @brief The next message without copying it, its header is peek_record()
+ *
+ * For the ring this points into the shared segment and stays valid until release().
+ *
+ * @return const char*
+ * Return the payload, NULL once the sender has exited
+ */
+const char* peek(mailbox_t *mailbox_ptr, unsigned short *length_ptr)
+{
+    batch_t *batch = &mailbox_ptr->batch;
+    frame_t *frame = batch->pending;
+
+    if (frame == NULL)
+        frame = fetch_frame(mailbox_ptr);
+    if (frame == NULL)
+        return NULL;
+
+    if (frame->type == MSG_EXIT) {
+        release_frame(mailbox_ptr);
+        return NULL;
+    }
+
+    record_t record;
+    uint64_t now = now_ns();
+    memcpy(&record, frame->data + batch->offset, RECORD_HEADER_SIZE);
+    if (mailbox_ptr->messages == 0)
+        mailbox_ptr->first_ns = now;
+    histogram_record(&mailbox_ptr->latency, now - record.stamp);
+
+    *length_ptr = record.length;
+    return frame->data + batch->offset + RECORD_HEADER_SIZE;
+}
+
+/**
+ * @brief Step past the message returned by the last peek()
+ */
+void release(mailbox_t *mailbox_ptr)
+{
+    batch_t *batch = &mailbox_ptr->batch;
+    frame_t *frame = batch->pending;
+    record_t record;
+
+    memcpy(&record, frame->data + batch->offset, RECORD_HEADER_SIZE);
+    batch->offset += RECORD_HEADER_SIZE + record.length;
+    mailbox_ptr->messages++;
+    mailbox_ptr->bytes += record.length;
+
+    // Only go back to the sender once every record of the frame is consumed
+    if (batch->offset >= frame->length)
+        release_frame(mailbox_ptr);
+}
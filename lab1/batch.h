@@ -0,0 +1,37 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "transport.h"
+
+/*
+ * Records batched into frames over a mailbox's transport.
+ * The sending end fills frames with reserve/commit and moves them with flush,
+ * the receiving end unpacks them with peek/release. An RPC end uses both halves, one per channel.
+ */
+
+void flush(mailbox_t* mailbox_ptr);
+void finish(mailbox_t* mailbox_ptr);
+void set_priority(mailbox_t* mailbox_ptr, unsigned int priority);
+char* reserve(mailbox_t* mailbox_ptr, unsigned short length);
+void commit(mailbox_t* mailbox_ptr, unsigned short length);
+void commit_with_id(mailbox_t* mailbox_ptr, unsigned short length, uint64_t id);
+
+const char* peek(mailbox_t* mailbox_ptr, unsigned short* length_ptr);
+void release(mailbox_t* mailbox_ptr);
+
+// Priority of the message peek() returned
+static inline unsigned int peek_priority(const mailbox_t *mailbox_ptr)
+{
+    return mailbox_ptr->batch.pending->priority;
+}
+
+// Header of the record whose payload peek() returned
+static inline record_t peek_record(const char *text)
+{
+    record_t record;
+
+    memcpy(&record, text - RECORD_HEADER_SIZE, RECORD_HEADER_SIZE);
+    return record;
+}
+
+#endif
@@ -0,0 +1,489 @@
+#include "benchmark.h"
+
+// transport.c adds to it, the benchmark never moves a frame itself
+_Thread_local double time_taken;
+
+// Byte streams move the whole file at once, only plain applies to them
+static const bench_mode_t modes[] = {
+    {"plain", "", "", 0},
+    {"batch", "-c 64", "", 1},
+    {"mmap", "-m", "", 1},
+    {"threads", "-T 2", "-O", 1},
+    {"pool", "", "-W 2", 1},
+    {"rpc", "-R 32", "-R", 1},
+};
+
+#define MODE_COUNT (sizeof(modes) / sizeof(modes[0]))
+
+static void sleep_ms(long ms){
+    struct timespec pause = {ms / 1000, ms % 1000 * 1000000L};
+
+    nanosleep(&pause, NULL);
+}
+
+/**
+ * @brief Parse a comma separated list of sizes, each may end in K or M
+ *
+ * @return int
+ * Return how many were parsed, -1 if one is not a positive number
+ */
+static int parse_sizes(const char *text, unsigned long *values, int max){
+    int count = 0;
+
+    while (*text != '\0' && count < max) {
+        char *end;
+        unsigned long value = strtoul(text, &end, 10);
+
+        if (*end == 'K' || *end == 'k') {
+            value <<= 10;
+            end++;
+        } else if (*end == 'M' || *end == 'm') {
+            value <<= 20;
+            end++;
+        }
+        if (end == text || value == 0 || (*end != ',' && *end != '\0'))
+            return -1;
+        values[count++] = value;
+        text = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+/**
+ * @brief Write lines lines of line_bytes printable bytes each, the first byte tells them apart
+ *
+ * @return int
+ * Return 0 on success, -1 on error
+ */
+static int generate_input(const char *path, unsigned long line_bytes, unsigned long lines){
+    FILE *file = fopen(path, "w");
+    char *line = malloc(line_bytes + 1);
+
+    if (file == NULL || line == NULL) {
+        perror("generate_input");
+        free(line);
+        if (file != NULL)
+            fclose(file);
+        return -1;
+    }
+    for (unsigned long i = 0; i < line_bytes; ++i)
+        line[i] = 'a' + i % 26;
+    line[line_bytes] = '\n';
+
+    for (unsigned long i = 0; i < lines; ++i) {
+        line[0] = 'A' + i % 26;
+        if (fwrite(line, line_bytes + 1, 1, file) != 1) {
+            perror("fwrite");
+            free(line);
+            fclose(file);
+            return -1;
+        }
+    }
+    free(line);
+    if (fclose(file) != 0) {
+        perror("fclose");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Start binary with options, then mechanism and input if given, its stdout and stderr on out or /dev/null if -1
+ *
+ * @return pid_t
+ * Return the child's pid, -1 on error
+ */
+static pid_t spawn(const char *binary, const char *options, const char *mechanism, const char *input, int out){
+    char copy[256];
+    char *argv[BENCH_MAX_ARGS];
+    char *token, *saved;
+    int argc = 0;
+    pid_t pid;
+
+    snprintf(copy, sizeof(copy), "%s", options);
+    argv[argc++] = (char *)binary;
+    for (token = strtok_r(copy, " ", &saved); token != NULL && argc < BENCH_MAX_ARGS - 3; token = strtok_r(NULL, " ", &saved))
+        argv[argc++] = token;
+    argv[argc++] = (char *)mechanism;
+    if (input != NULL)
+        argv[argc++] = (char *)input;
+    argv[argc] = NULL;
+
+    pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        if (out == -1)
+            out = open("/dev/null", O_WRONLY);
+        dup2(out, STDOUT_FILENO);
+        dup2(out, STDERR_FILENO);
+        execv(binary, argv);
+        perror(binary);
+        _exit(127);
+    }
+    return pid;
+}
+
+/**
+ * @brief Wait up to timeout_ms for pid to exit
+ *
+ * @return int
+ * Return 1 once it has, with its status in status_ptr, 0 on timeout
+ */
+static int wait_exit(pid_t pid, int *status_ptr, long timeout_ms){
+    for (long waited = 0; ; waited += 10) {
+        if (waitpid(pid, status_ptr, WNOHANG) == pid)
+            return 1;
+        if (waited >= timeout_ms)
+            return 0;
+        sleep_ms(10);
+    }
+}
+
+/**
+ * @brief Pick the throughput and latency summary out of one line the receiver printed
+ */
+static void parse_report(const char *line, bench_result_t *result){
+    if (sscanf(line, "Receiver throughput: %llu msgs, %llu bytes in %lfs, %lf msgs/s, %lf MB/s",
+               &result->messages, &result->bytes, &result->seconds, &result->msgs_per_s, &result->mb_per_s) == 5)
+        return;
+    if (sscanf(line, "End-to-end latency (us): p50 %lf p90 %lf p99 %lf p99.9 %lf max %lf",
+               &result->p50, &result->p90, &result->p99, &result->p999, &result->max) == 5)
+        result->has_latency = 1;
+}
+
+/**
+ * @brief Read the receiver's output until it closes it, keeping only the start of each line
+ *
+ * Every message is printed too, so this has to keep draining for the receiver not to block on the pipe.
+ *
+ * @return int
+ * Return 1 at the end of the output, 0 if it is not done after timeout_ms
+ */
+static int read_report(int fd, bench_result_t *result, long timeout_ms){
+    static char chunk[1 << 16];
+    char line[BENCH_LINE];
+    size_t length = 0;
+    struct timespec start, now;
+    struct pollfd readable = {fd, POLLIN, 0};
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long left = timeout_ms - ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000);
+        if (left <= 0 || poll(&readable, 1, left) == 0)
+            return 0;
+
+        ssize_t got = read(fd, chunk, sizeof(chunk));
+        if (got == -1 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return 1;
+        for (ssize_t i = 0; i < got; ++i) {
+            if (chunk[i] != '\n') {
+                if (length < sizeof(line) - 1)
+                    line[length++] = chunk[i];
+                continue;
+            }
+            line[length] = '\0';
+            parse_report(line, result);
+            length = 0;
+        }
+    }
+}
+
+/**
+ * @brief One sender/receiver pair over input, the receiver started delay_ms after the sender as the lab requires
+ *
+ * The sender runs with -g, so it holds its first message back until the receiver is open
+ * and the receiver's start-up counts neither as latency nor against the throughput.
+ */
+static void run_once(bench_result_t *result, const char *input, long delay_ms, long timeout_ms){
+    char mechanism[16], options[256];
+    int out[2], status, sender_done, finished;
+    pid_t sender, receiver;
+
+    snprintf(mechanism, sizeof(mechanism), "%d", result->transport->id);
+    snprintf(options, sizeof(options), "-g %s", result->mode->sender_options);
+    sender = spawn("./sender", options, mechanism, input, -1);
+    if (sender == -1) {
+        result->status = "error";
+        return;
+    }
+    sleep_ms(delay_ms);
+
+    // A sender that has already exited refused the options, it waits for the receiver otherwise
+    sender_done = waitpid(sender, &status, WNOHANG) == sender;
+    if (sender_done) {
+        result->status = "rejected";
+        return;
+    }
+
+    if (pipe(out) == -1) {
+        perror("pipe");
+        kill(sender, SIGKILL);
+        waitpid(sender, NULL, 0);
+        result->status = "error";
+        return;
+    }
+    receiver = spawn("./receiver", result->mode->receiver_options, mechanism, NULL, out[1]);
+    close(out[1]);
+    finished = receiver != -1 && read_report(out[0], result, timeout_ms);
+    close(out[0]);
+
+    if (receiver != -1) {
+        if (!finished)
+            kill(receiver, SIGKILL);
+        waitpid(receiver, &status, 0);
+    }
+    if (!finished)
+        result->status = "timeout";
+    else if (!(WIFEXITED(status) && WEXITSTATUS(status) == 0))
+        result->status = result->messages > 0 ? "failed" : "rejected";
+    else if (result->messages == 0)
+        result->status = "empty";     // nothing delivered, no throughput to report
+    else
+        result->status = "ok";
+
+    // The sender may be waiting for a receiver that is gone
+    if (!sender_done && (strcmp(result->status, "ok") != 0 || !wait_exit(sender, &status, timeout_ms))) {
+        kill(sender, SIGKILL);
+        waitpid(sender, NULL, 0);
+    }
+}
+
+static void write_csv_row(FILE *csv, const bench_result_t *result){
+    fprintf(csv, "%d,%s,%s,%lu,%lu,%u,%s,%llu,%llu,%.6f,%.0f,%.2f,",
+            result->transport->id, result->transport->name, result->mode->name, result->line_bytes, result->lines,
+            result->run, result->status, result->messages, result->bytes, result->seconds, result->msgs_per_s,
+            result->mb_per_s);
+    if (result->has_latency)
+        fprintf(csv, "%.3f,%.3f,%.3f,%.3f,%.3f\n", result->p50, result->p90, result->p99, result->p999, result->max);
+    else
+        fprintf(csv, ",,,,\n");
+    fflush(csv);
+}
+
+static int compare_doubles(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Median of the field at offset over the runs that finished, 0 if none did
+ */
+static double median(const bench_result_t *results, unsigned int runs, size_t offset, int latency){
+    double values[runs];
+    unsigned int count = 0;
+
+    for (unsigned int i = 0; i < runs; ++i)
+        if (strcmp(results[i].status, "ok") == 0 && (!latency || results[i].has_latency))
+            values[count++] = *(const double *)((const char *)&results[i] + offset);
+    if (count == 0)
+        return 0;
+    qsort(values, count, sizeof(double), compare_doubles);
+    return count % 2 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+/**
+ * @brief One row per mechanism, mode and input: medians over the repeated runs, latency in us
+ */
+static void print_summary(const bench_result_t *results, unsigned int total, unsigned int repeats){
+    printf("\n%-4s %-10s %-8s %8s %8s %4s %12s %10s %10s %10s %10s %10s\n", "mech", "name", "mode", "line", "lines",
+           "ok", "msgs/s", "MB/s", "p50", "p99", "p99.9", "max");
+    for (unsigned int g = 0; g < total; g += repeats) {
+        const bench_result_t *group = &results[g];
+        unsigned int ok = 0;
+
+        for (unsigned int i = 0; i < repeats; ++i)
+            ok += strcmp(group[i].status, "ok") == 0;
+        printf("%-4d %-10s %-8s %8lu %8lu %u/%u", group->transport->id, group->transport->name, group->mode->name,
+               group->line_bytes, group->lines, ok, repeats);
+        if (ok == 0) {
+            printf("  %s\n", group[repeats - 1].status);
+            continue;
+        }
+        printf(" %12.0f %10.2f", median(group, repeats, offsetof(bench_result_t, msgs_per_s), 0),
+               median(group, repeats, offsetof(bench_result_t, mb_per_s), 0));
+        if (group->has_latency)
+            printf(" %10.1f %10.1f %10.1f %10.1f\n", median(group, repeats, offsetof(bench_result_t, p50), 1),
+                   median(group, repeats, offsetof(bench_result_t, p99), 1),
+                   median(group, repeats, offsetof(bench_result_t, p999), 1),
+                   median(group, repeats, offsetof(bench_result_t, max), 1));
+        else
+            printf(" %10s %10s %10s %10s\n", "-", "-", "-", "-");
+    }
+}
+
+int main(int argc, char *argv[]){
+    /*
+        Sweep every mechanism and mode over synthetic inputs of each line size and count, each run repeated,
+        one CSV row per run and a table of the medians at the end.
+        Lines longer than a message are split by the sender, so above 1 KB the line size is what varies, not the message size.
+        Messages queued before the receiver starts carry the start delay, which shows in the top percentiles.
+        • e.g. ./benchmark, or ./benchmark -s 16,1K -n 1000,100000 -m ring,mq -M plain,batch -r 5
+    */
+    const char *sizes_list = "16,256,4K,64K,1M";
+    const char *counts_list = "10000";
+    const char *mechanisms_list = NULL;
+    const char *modes_list = NULL;
+    const char *csv_file = "bench.csv";
+    unsigned int repeats = 3;
+    long delay_ms = 100;
+    long timeout_ms = 60000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:n:m:M:r:o:D:t:")) != -1) {
+        switch (opt) {
+        case 's':
+            sizes_list = optarg;
+            break;
+        case 'n':
+            counts_list = optarg;
+            break;
+        case 'm':
+            mechanisms_list = optarg;
+            break;
+        case 'M':
+            modes_list = optarg;
+            break;
+        case 'r':
+            repeats = atoi(optarg);
+            break;
+        case 'o':
+            csv_file = optarg;
+            break;
+        case 'D':
+            delay_ms = atol(optarg);
+            break;
+        case 't':
+            timeout_ms = atol(optarg) * 1000;
+            break;
+        default:
+            argc = -1;
+        }
+    }
+
+    unsigned long sizes[32], counts[32];
+    int size_count = parse_sizes(sizes_list, sizes, 32);
+    int count_count = parse_sizes(counts_list, counts, 32);
+    if (argc < 0 || argc != optind || size_count <= 0 || count_count <= 0 || repeats == 0 || delay_ms < 0 || timeout_ms <= 0) {
+        printf("Usage: ./benchmark [-s line_bytes,...] [-n lines,...] [-m mechanism,...] [-M mode,...] [-r repeats] [-o csv_file] [-D start_delay_ms] [-t timeout_s]\n");
+        transport_usage(stdout);
+        printf("Modes:");
+        for (unsigned int i = 0; i < MODE_COUNT; ++i)
+            printf(" %s", modes[i].name);
+        printf("\n");
+        return -1;
+    }
+
+    /* Mechanisms and modes to sweep, all of them unless listed */
+    const transport_t *transports[64];
+    int transport_count = 0;
+    if (mechanisms_list == NULL) {
+        char id[16];
+        for (int i = 1; snprintf(id, sizeof(id), "%d", i), transport_find(id) != NULL && transport_count < 64; ++i)
+            transports[transport_count++] = transport_find(id);
+    } else {
+        char copy[256], *token, *saved;
+        snprintf(copy, sizeof(copy), "%s", mechanisms_list);
+        for (token = strtok_r(copy, ",", &saved); token != NULL && transport_count < 64; token = strtok_r(NULL, ",", &saved)) {
+            if ((transports[transport_count++] = transport_find(token)) == NULL) {
+                fprintf(stderr, "No mechanism %s\n", token);
+                return -1;
+            }
+        }
+    }
+
+    const bench_mode_t *selected[MODE_COUNT];
+    unsigned int mode_count = 0;
+    for (unsigned int i = 0; i < MODE_COUNT; ++i) {
+        char copy[256], *token, *saved;
+        if (modes_list == NULL) {
+            selected[mode_count++] = &modes[i];
+            continue;
+        }
+        snprintf(copy, sizeof(copy), "%s", modes_list);
+        for (token = strtok_r(copy, ",", &saved); token != NULL; token = strtok_r(NULL, ",", &saved))
+            if (strcmp(token, modes[i].name) == 0) {
+                selected[mode_count++] = &modes[i];
+                break;
+            }
+    }
+    if (mode_count == 0) {
+        fprintf(stderr, "No such mode in %s\n", modes_list);
+        return -1;
+    }
+
+    unsigned int total = 0;
+    for (int t = 0; t < transport_count; ++t)
+        for (unsigned int m = 0; m < mode_count; ++m)
+            if (transports[t]->claim != NULL || !selected[m]->frames_only)
+                total += size_count * count_count * repeats;
+    bench_result_t *results = calloc(total, sizeof(bench_result_t));
+    if (results == NULL) {
+        perror("calloc");
+        return -1;
+    }
+
+    FILE *csv = fopen(csv_file, "w");
+    if (csv == NULL) {
+        perror("fopen");
+        return -1;
+    }
+    fprintf(csv, "mechanism,name,mode,line_bytes,lines,run,status,messages,bytes,seconds,msgs_per_s,mb_per_s,"
+                 "p50_us,p90_us,p99_us,p999_us,max_us\n");
+
+    char dir[] = "/tmp/benchmark.XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return -1;
+    }
+
+    /* The input is generated once per line size and count, every mechanism reads the same file */
+    unsigned int done = 0;
+    for (int s = 0; s < size_count; ++s) {
+        for (int c = 0; c < count_count; ++c) {
+            unsigned long lines = counts[c];
+            char input[PATH_MAX];
+
+            if (lines > BENCH_MAX_INPUT / (sizes[s] + 1))
+                lines = BENCH_MAX_INPUT / (sizes[s] + 1) > 0 ? BENCH_MAX_INPUT / (sizes[s] + 1) : 1;
+            snprintf(input, sizeof(input), "%s/%lu_x_%lu.txt", dir, sizes[s], lines);
+            if (generate_input(input, sizes[s], lines) == -1)
+                return -1;
+
+            for (int t = 0; t < transport_count; ++t) {
+                for (unsigned int m = 0; m < mode_count; ++m) {
+                    if (transports[t]->claim == NULL && selected[m]->frames_only)
+                        continue;
+                    for (unsigned int r = 1; r <= repeats; ++r) {
+                        bench_result_t *result = &results[done++];
+
+                        result->transport = transports[t];
+                        result->mode = selected[m];
+                        result->line_bytes = sizes[s];
+                        result->lines = lines;
+                        result->run = r;
+                        run_once(result, input, delay_ms, timeout_ms);
+                        write_csv_row(csv, result);
+                        fprintf(stderr, "[%u/%u] %s %s %lu B x %lu, run %u: %s, %.0f msgs/s\n", done, total,
+                                result->transport->name, result->mode->name, sizes[s], lines, r, result->status,
+                                result->msgs_per_s);
+                    }
+                }
+            }
+            unlink(input);
+        }
+    }
+    rmdir(dir);
+    fclose(csv);
+
+    print_summary(results, total, repeats);
+    printf("\nEvery run is in %s\n", csv_file);
+    free(results);
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "transport.h"
+
+#define BENCH_MAX_INPUT (64UL << 20)   // largest input file, the count of long lines is cut down to fit
+#define BENCH_MAX_ARGS 16
+#define BENCH_LINE 4096                // receiver output kept per line, only the short summary lines are parsed
+
+// Options a run passes to each end on top of the mechanism
+typedef struct bench_mode {
+    const char *name;
+    const char *sender_options;
+    const char *receiver_options;
+    int frames_only;                   // the byte streams reject or ignore these options
+} bench_mode_t;
+
+// What one run's receiver reported, status is "ok" or why there are no numbers
+typedef struct bench_result {
+    const transport_t *transport;
+    const bench_mode_t *mode;
+    unsigned long line_bytes;
+    unsigned long lines;
+    unsigned int run;
+    const char *status;
+    unsigned long long messages;
+    unsigned long long bytes;
+    double seconds;
+    double msgs_per_s;
+    double mb_per_s;
+    int has_latency;                   // the byte streams carry no records to time
+    double p50, p90, p99, p999, max;   // end-to-end latency in us
+} bench_result_t;
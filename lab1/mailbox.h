@@ -0,0 +1,418 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <stdatomic.h>
+#include <time.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <semaphore.h>
+#include <mqueue.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "stats.h"
+
+#define MAX_MESSAGE_SIZE 1025
+
+#define FRAME_SIZE 8192   // one mq message / shm buffer, at most the default msgsize_max
+#define FRAME_HEADER_SIZE (sizeof(unsigned int) + sizeof(unsigned short) + 2 * sizeof(unsigned char))
+#define RECORD_HEADER_SIZE sizeof(record_t)
+
+#define RING_SLOTS 256     // must be a power of two
+#define RING_MAGIC 0x52494e47u
+
+#define MPMC_SLOTS 64      // must be a power of two
+#define MPMC_FREE 0        // mpmc_t.state: segment not set up yet
+#define MPMC_INIT 1        // a sender is setting it up
+#define MPMC_READY 2
+#define MPMC_MAX_ATTACHED 64   // senders and receivers whose pid one queue records
+
+#define PRIORITY_LEVELS 4     // 0 for bulk data up to PRIORITY_LEVELS - 1 for the most urgent
+#define LANE_SLOTS 64          // slots of each priority lane of mechanism 11, must be a power of two
+#define STARVATION_LIMIT 8     // a lane with frames waiting is passed over for more urgent ones at most this often in a row
+
+#define BROADCAST_SUBSCRIBERS 16   // receivers one broadcast of mechanism 14 can have
+
+#define STREAM_CHUNK_SIZE (4 << 20)   // each of the two chunks of mechanism 5, a multiple of 8
+#define STREAM_CHUNKS 2
+
+#define WAIT_POLL 0       // spin until the peer moves, never sleep
+#define WAIT_FUTEX 1      // spin for spin_budget rounds, then sleep on a futex in the ring
+#define WAIT_SEM 2        // count slots with the named semaphores, as mechanisms 1 and 2 do
+#define WAIT_EVENTFD 3    // spin for spin_budget rounds, then block reading an eventfd handed over by the sender
+#define DEFAULT_SPIN_BUDGET 1000
+
+#define MSG_DATA 0        // regular message / frame of records
+#define MSG_EXIT 1        // end of stream, carries no payload
+#define MSG_SWITCH 2      // mechanism 15: the frames after this one come on the transport data[0] names
+
+/*
+ * Only the first length bytes of msg_text are meaningful, they are not '\0' terminated.
+ * Transports copy exactly length bytes, never the whole array.
+ */
+typedef struct {
+    unsigned short type;              // MSG_DATA or MSG_EXIT
+    unsigned short length;            // bytes used in msg_text
+    unsigned short priority;          // 0 to PRIORITY_LEVELS - 1, higher goes first
+    uint64_t stamp;                   // now_ns() when the sender committed it, set by commit()
+    uint64_t id;                      // record id, set by commit()
+    char msg_text[MAX_MESSAGE_SIZE];  // Message text
+} message_t;
+
+/*
+ * Header in front of every record, copied in and out with memcpy since records are not aligned.
+ */
+typedef struct {
+    unsigned short length;     // payload bytes that follow, without the '\0'
+    uint64_t stamp;            // now_ns() when the sender committed the record
+    uint64_t id;               // numbered in commit order, a reply carries the id of its request
+} __attribute__((packed)) record_t;
+
+/*
+ * Unit moved by every mechanism: a batch of records, each a record_t followed by its payload.
+ * Only FRAME_HEADER_SIZE + length bytes are meaningful.
+ */
+typedef struct {
+    unsigned int length;                         // bytes used in data
+    unsigned short count;                        // number of records in data
+    unsigned char type;                          // MSG_DATA, or MSG_EXIT as a control frame without records
+    unsigned char priority;                      // of every record in the frame, 0 to PRIORITY_LEVELS - 1
+    char data[FRAME_SIZE - FRAME_HEADER_SIZE];
+} frame_t;
+
+typedef struct {
+    frame_t frame;             // staging frame for the transports that copy frames out
+    frame_t *pending;          // frame being filled / unpacked: &frame or a shared slot, NULL if none
+    unsigned long position;    // receiver: queue position of pending (mechanism 4)
+    unsigned int offset;       // receiver: next record in pending
+    unsigned int max_count;    // sender: flush after this many records
+    unsigned int max_bytes;    // sender: flush once frame.length reaches this
+    long max_delay_ns;         // sender: flush once the oldest record is this old, 0 disables
+    unsigned int priority;     // sender: priority of the records committed next
+    struct timespec first;     // sender: when the oldest record was added
+    int spilled;               // sender: the last reserve() handed out spill, not room in pending
+    char spill[MAX_MESSAGE_SIZE];  // sender: a reservation that did not fit behind the records in pending
+} batch_t;
+
+/*
+ * Futex word a WAIT_FUTEX side sleeps on.
+ * The waker only bumps seq and enters the kernel when waiting is set.
+ */
+typedef struct {
+    atomic_uint seq;
+    atomic_uint waiting;
+} waitpoint_t;
+
+/*
+ * Layout of the shared segment for mechanism 3.
+ * The sender owns head and the receiver owns tail, each on its own cache line
+ * so the two processes never write to the same line.
+ * Free-running indices: slot = index & (capacity - 1), full when head - tail == capacity.
+ */
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_uint magic;   // set to RING_MAGIC once initialized
+    unsigned int capacity;                          // number of slots
+    unsigned int wait_strategy;                     // WAIT_POLL, WAIT_FUTEX, WAIT_SEM or WAIT_EVENTFD, chosen by the sender
+    unsigned int spin_budget;                       // sender's spin budget, the receiver's default
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong head;   // next slot the sender writes
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong tail;   // next slot the receiver reads
+    _Alignas(CACHE_LINE_SIZE) waitpoint_t data;    // the receiver sleeps here while the ring is empty
+    _Alignas(CACHE_LINE_SIZE) waitpoint_t space;   // the sender sleeps here while the ring is full
+    _Alignas(CACHE_LINE_SIZE) frame_t slots[RING_SLOTS];
+} ring_t;
+
+/*
+ * Bounded multi-producer/multi-consumer queue for mechanism 4, after Dmitry Vyukov's design.
+ * Each cell's seq tells whose turn it is for lap position / capacity:
+ * seq == position means free for the producer that claims position,
+ * seq == position + 1 means published for the consumer that claims position.
+ * Producers and consumers claim positions with a CAS on their own counter, there is no lock.
+ */
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong seq;
+    frame_t frame;
+} mpmc_cell_t;
+
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_uint state;   // MPMC_FREE, MPMC_INIT or MPMC_READY
+    unsigned int capacity;                          // number of cells
+    unsigned int producers;                         // senders sharing the channel
+    atomic_uint finished;                           // senders that have sent everything
+    atomic_uint attached;                           // processes that recorded their pid in pids
+    pid_t pids[MPMC_MAX_ATTACHED];                  // senders and receivers of the run, once none is left it is stale
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong enqueue_pos;
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong dequeue_pos;
+    _Alignas(CACHE_LINE_SIZE) mpmc_cell_t cells[MPMC_SLOTS];
+} mpmc_t;
+
+/*
+ * Layout of the shared segment for mechanism 5: the input file streamed through two large chunks.
+ * Same head/tail scheme as ring_t, the sender fills one chunk while the receiver drains the other.
+ */
+typedef struct {
+    unsigned long length;      // bytes used in data
+    unsigned int last;         // set on the final chunk, which may be empty
+    _Alignas(CACHE_LINE_SIZE) char data[STREAM_CHUNK_SIZE];
+} stream_chunk_t;
+
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_uint magic;   // set to RING_MAGIC once initialized
+    unsigned int spin_budget;                       // sender's spin budget, the receiver's default
+    uint64_t checksum;                              // checksum_update() over the whole stream, valid with the last chunk
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong head;   // chunks the sender has filled
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong tail;   // chunks the receiver has drained
+    _Alignas(CACHE_LINE_SIZE) waitpoint_t data;
+    _Alignas(CACHE_LINE_SIZE) waitpoint_t space;
+    _Alignas(CACHE_LINE_SIZE) stream_chunk_t chunks[STREAM_CHUNKS];
+} stream_t;
+
+/*
+ * Layout of the shared segment for mechanism 11: one SPSC ring per priority.
+ * The sender publishes a frame in the lane of its priority, then counts it in published,
+ * which is all the receiver has to watch while every lane is empty.
+ */
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong head;   // next slot the sender writes
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong tail;   // next slot the receiver reads
+    _Alignas(CACHE_LINE_SIZE) frame_t slots[LANE_SLOTS];
+} lane_t;
+
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_uint magic;   // set to RING_MAGIC once initialized
+    unsigned int wait_strategy;                     // WAIT_POLL or WAIT_FUTEX, chosen by the sender
+    unsigned int spin_budget;                       // sender's spin budget, the receiver's default
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong published;   // frames published over all lanes
+    _Alignas(CACHE_LINE_SIZE) waitpoint_t data;    // the receiver sleeps here while every lane is empty
+    _Alignas(CACHE_LINE_SIZE) waitpoint_t space;   // the sender sleeps here while its lane is full
+    lane_t lanes[PRIORITY_LEVELS];
+} lanes_t;
+
+/*
+ * Receiver's side of mechanism 11.
+ */
+typedef struct {
+    unsigned long consumed;                     // frames released over all lanes
+    unsigned int current;                       // lane of the frame being read
+    unsigned int passed_over[PRIORITY_LEVELS];  // times in a row each lane had frames waiting and was not served
+    uint64_t frames[PRIORITY_LEVELS];           // frames taken from each lane
+    uint64_t rescued;                           // frames taken from a starving lane ahead of more urgent ones
+} lane_state_t;
+
+/*
+ * Layout of the shared segment for mechanism 14: a ring every subscriber reads in full.
+ * The sender writes each frame once, in place, with a reference per subscriber. Each subscriber
+ * follows the ring with a cursor of its own and drops its reference as it passes a slot, and the
+ * one dropping the last counts the slot in reclaimed. Subscribers pass slots in order, so the
+ * slowest one moves reclaimed and it is all the sender has to wait on while the ring is full.
+ */
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong cursor;  // next slot this subscriber reads
+    _Alignas(CACHE_LINE_SIZE) waitpoint_t data;     // it sleeps here while it has read every slot published
+} subscriber_t;
+
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_uint magic;   // set to RING_MAGIC once initialized
+    unsigned int subscribers;                       // receivers the sender waits for before the first frame
+    unsigned int wait_strategy;                     // WAIT_POLL or WAIT_FUTEX, chosen by the sender
+    unsigned int spin_budget;                       // sender's spin budget, the receivers' default
+    atomic_ulong registered;                        // receivers that have taken a subscriber slot
+    waitpoint_t joined;                             // the sender sleeps here until every subscriber has registered
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong head;   // next slot the sender writes
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong reclaimed;   // slots every subscriber has passed
+    _Alignas(CACHE_LINE_SIZE) waitpoint_t space;   // the sender sleeps here while the ring is full or draining
+    subscriber_t subscriber[BROADCAST_SUBSCRIBERS];
+    _Alignas(CACHE_LINE_SIZE) atomic_uint refs[RING_SLOTS];   // subscribers yet to pass each slot
+    _Alignas(CACHE_LINE_SIZE) frame_t slots[RING_SLOTS];
+} broadcast_t;
+
+/*
+ * Layout of the shared segment for mechanism 12: only the latest frame, under a seqlock.
+ * The writer makes seq odd, overwrites value and makes seq even again. A reader copies value out
+ * between two loads of seq and tries again if they differ or were odd, so readers never write
+ * to the segment per value and any number of them can follow the writer without holding it up.
+ */
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_uint magic;   // set to RING_MAGIC once initialized
+    atomic_uint closed;                             // the writer has published its last value
+    atomic_uint readers;                            // attached readers, the last one out after the writer removes the segment
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong seq;    // twice the values published, odd while one is being written
+    _Alignas(CACHE_LINE_SIZE) frame_t value;
+} latest_t;
+
+/*
+ * Reader's side of mechanism 12.
+ */
+typedef struct {
+    unsigned long seen;       // seq of the value read last, 0 before the first
+    uint64_t skipped;         // values overwritten before this reader got to them
+    uint64_t retries;         // copies thrown away because the writer moved meanwhile
+} latest_state_t;
+
+#define SPIN_BUDGET_UNSET UINT_MAX   // receiver: take the spin budget from the sender
+
+struct transport;
+struct rpc;
+struct arena_segment;
+struct adaptive;
+
+typedef struct {
+    int flag;      // id of the transport: 1 for message passing, 2 for shared memory, 3 for shared memory ring, ... see transport.c
+    const struct transport *transport;
+    const char *channel;          // appended to the names of every IPC object, NULL for the plain names
+    union{
+        //int msqid; //for system V api. You can replace it with struecture for POSIX api
+        mqd_t mqd;         // POSIX message queue descriptor
+        char* shm_addr;
+        ring_t* ring;
+        mpmc_t* mpmc;
+        stream_t* stream;
+        lanes_t* lanes;
+        latest_t* latest;
+        struct arena_segment* arena;
+        broadcast_t* broadcast;
+        struct adaptive* adaptive;
+        int fd;            // pipe, FIFO or socket
+    }storage;
+    sem_t* sem_send;
+    sem_t* sem_receive;
+    int notify[2];                // WAIT_EVENTFD: eventfds signalling data and space
+    int wait_strategy;            // ring only, the stream always uses WAIT_FUTEX
+    unsigned int spin_budget;     // ring, MPMC and stream
+    unsigned int queue_depth;     // sender: message queue depth
+    unsigned int credits;         // sender: message queue frames in flight
+    unsigned int producers;       // sender: senders sharing the MPMC queue
+    unsigned int subscribers;     // sender: receivers of a broadcast; receiver: its subscriber slot
+    const char *huge_dir;         // hugetlbfs mount to put the ring, MPMC or stream segment in, NULL for POSIX shm
+    int segment_huge;             // the segment is a file in huge_dir rather than POSIX shm
+    size_t segment_size;          // bytes mapped, rounded up to the huge page size on hugetlbfs
+    batch_t batch;
+    lane_state_t lanes;           // receiver, mechanism 11
+    latest_state_t latest;        // receiver, mechanism 12
+    struct rpc *rpc;              // sender in RPC mode: outstanding requests and their replies, NULL otherwise
+    uint64_t frames;              // frames moved so far
+    uint64_t wire_bytes;          // frame bytes moved so far, headers included
+    uint64_t sleeps;              // times this end blocked waiting for the other
+    uint64_t messages;            // messages committed / released so far
+    uint64_t bytes;               // payload bytes committed / released so far
+    uint64_t first_ns;            // when the first message was committed / peeked
+    histogram_t latency;          // receiver: commit to peek time of every message
+    stats_page_t *page;           // live counters for ./monitor, NULL if not open
+    stats_side_t *live;           // this end's side of page
+    stats_totals_t published;     // what this end has added to live so far
+} mailbox_t;
+
+/*
+ * Bring this end's side of the stats page up to date, transports call it for every frame.
+ */
+static inline void stats_publish(mailbox_t *mailbox_ptr)
+{
+    stats_totals_t totals = {mailbox_ptr->messages, mailbox_ptr->bytes, mailbox_ptr->frames, mailbox_ptr->sleeps};
+
+    if (mailbox_ptr->live != NULL)
+        stats_page_publish(mailbox_ptr->live, &mailbox_ptr->published, &totals, mailbox_ptr->latency.max);
+}
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/*
+ * Sleep on wp->seq until it moves away from seq.
+ * Callers set waiting and re-check their condition after a seq_cst fence before calling this,
+ * waitpoint_wake() does the mirror image, so one of the two always sees the other.
+ */
+static inline void waitpoint_sleep(waitpoint_t *wp, unsigned int seq)
+{
+    syscall(SYS_futex, &wp->seq, FUTEX_WAIT, seq, NULL, NULL, 0);
+}
+
+static inline void waitpoint_wake(waitpoint_t *wp)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&wp->waiting, memory_order_relaxed)) {
+        atomic_fetch_add_explicit(&wp->seq, 1, memory_order_relaxed);
+        syscall(SYS_futex, &wp->seq, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+/*
+ * Block while *counter still equals value, the way strategy says (WAIT_POLL or WAIT_FUTEX).
+ * Both ends of an SPSC segment use it: the sender waits on the receiver's counter to free
+ * a slot, the receiver on the sender's counter to publish one, and wp is where they sleep.
+ * Return how many times it went to sleep.
+ */
+static inline unsigned int wait_while_equal(atomic_ulong *counter, unsigned long value, waitpoint_t *wp,
+                                            int strategy, unsigned int spin_budget)
+{
+    unsigned int spins = 0, sleeps = 0;
+
+    while (atomic_load_explicit(counter, memory_order_acquire) == value) {
+        if (strategy == WAIT_POLL || spins < spin_budget) {
+            spins++;
+            cpu_relax();
+            continue;
+        }
+
+        // Announce the sleep, then re-check so a move in between is not missed
+        unsigned int seq = atomic_load_explicit(&wp->seq, memory_order_acquire);
+        atomic_store_explicit(&wp->waiting, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(counter, memory_order_acquire) == value) {
+            waitpoint_sleep(wp, seq);
+            sleeps++;
+        }
+        atomic_store_explicit(&wp->waiting, 0, memory_order_relaxed);
+    }
+    return sleeps;
+}
+
+/*
+ * Fletcher-style checksum over 64-bit words, fast enough to keep up with memcpy.
+ * sum[1] accumulates sum[0] so reordered data changes the result.
+ * Feed it in pieces whose lengths are multiples of 8, except the last.
+ */
+static inline void checksum_update(uint64_t sum[2], const char *data, size_t length)
+{
+    uint64_t a = sum[0], b = sum[1], word;
+    size_t i;
+
+    for (i = 0; i + 8 <= length; i += 8) {
+        memcpy(&word, data + i, 8);
+        a += word;
+        b += a;
+    }
+    if (i < length) {
+        word = 0;
+        memcpy(&word, data + i, length - i);
+        a += word;
+        b += a;
+    }
+    sum[0] = a;
+    sum[1] = b;
+}
+
+static inline uint64_t checksum_final(const uint64_t sum[2])
+{
+    return sum[0] ^ (sum[1] * 0x9e3779b97f4a7c15ull);
+}
+
+static inline int parse_wait_strategy(const char *name)
+{
+    if (strcmp(name, "poll") == 0)
+        return WAIT_POLL;
+    if (strcmp(name, "futex") == 0)
+        return WAIT_FUTEX;
+    if (strcmp(name, "sem") == 0)
+        return WAIT_SEM;
+    if (strcmp(name, "eventfd") == 0)
+        return WAIT_EVENTFD;
+    return -1;
+}
+
+#endif
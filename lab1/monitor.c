@@ -0,0 +1,101 @@
+#include "monitor.h"
+
+static void print_rates(const stats_page_t* page, const stats_totals_t* sent, const stats_totals_t* received,
+                        const stats_totals_t* last_sent, const stats_totals_t* last_received, double elapsed, double seconds){
+    /*
+        One line per interval: what each side moved per second, what is queued between them and how often they blocked
+    */
+    printf("[%7.1fs] %s  sent %.0f msg/s %.2f MB/s  received %.0f msg/s %.2f MB/s  in flight %lld frames %lld msgs"
+           "  blocked/s sender %.0f receiver %.0f  max latency %.1f us\n",
+           elapsed, page->transport,
+           (sent->messages - last_sent->messages) / seconds, (sent->bytes - last_sent->bytes) / seconds / 1e6,
+           (received->messages - last_received->messages) / seconds, (received->bytes - last_received->bytes) / seconds / 1e6,
+           (long long)(sent->frames - received->frames), (long long)(sent->messages - received->messages),
+           (sent->blocked - last_sent->blocked) / seconds, (received->blocked - last_received->blocked) / seconds,
+           atomic_load_explicit(&page->receiver.max_latency_ns, memory_order_relaxed) / 1e3);
+}
+
+static void read_side(const stats_side_t* side, stats_totals_t* totals){
+    totals->messages = atomic_load_explicit(&side->messages, memory_order_relaxed);
+    totals->bytes = atomic_load_explicit(&side->bytes, memory_order_relaxed);
+    totals->frames = atomic_load_explicit(&side->frames, memory_order_relaxed);
+    totals->blocked = atomic_load_explicit(&side->blocked, memory_order_relaxed);
+}
+
+static int side_closed(const stats_side_t* side){
+    unsigned int attached = atomic_load_explicit(&side->attached, memory_order_relaxed);
+
+    return attached > 0 && atomic_load_explicit(&side->closed, memory_order_relaxed) == attached;
+}
+
+int main(int argc, char *argv[]){
+    /*
+        Attach to the stats page of a running sender/receiver pair read-only and print its rates every interval,
+        until both ends have closed.
+        • e.g. ./monitor, or ./monitor -i 100 reply for the RPC reply channel
+    */
+    long interval_ms = 1000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:")) != -1) {
+        switch (opt) {
+        case 'i':
+            interval_ms = atol(optarg);
+            break;
+        default:
+            argc = -1;
+        }
+    }
+    if (argc < 0 || argc - optind > 1 || interval_ms <= 0) {
+        printf("Usage: ./monitor [-i interval_ms] [channel]\n");
+        return -1;
+    }
+
+    char name[NAME_MAX];
+    if (argc - optind == 1)
+        snprintf(name, sizeof(name), "%s_%s", STATS_PAGE, argv[optind]);
+    else
+        snprintf(name, sizeof(name), "%s", STATS_PAGE);
+
+    // Wait for a sender to set the page up
+    struct timespec interval = {interval_ms / 1000, interval_ms % 1000 * 1000000L};
+    stats_page_t *page;
+    int fd;
+    while ((fd = shm_open(name, O_RDONLY, 0)) == -1)
+        nanosleep(&interval, NULL);
+    close(fd);
+    page = stats_page_map(name, O_RDONLY);
+    if (page == NULL)
+        return -1;
+    while (atomic_load_explicit(&page->magic, memory_order_acquire) != STATS_MAGIC)
+        nanosleep(&interval, NULL);
+    printf("Monitoring %s\n", name + 1);
+
+    stats_totals_t sent, received, last_sent, last_received;
+    uint64_t start = now_ns(), last = start;
+    read_side(&page->sender, &last_sent);
+    read_side(&page->receiver, &last_received);
+
+    for (;;) {
+        nanosleep(&interval, NULL);
+        // Read the closed counts first, so the totals printed for a closed channel are final
+        int done = side_closed(&page->sender) && side_closed(&page->receiver);
+        uint64_t now = now_ns();
+
+        read_side(&page->sender, &sent);
+        read_side(&page->receiver, &received);
+        print_rates(page, &sent, &received, &last_sent, &last_received, (now - start) / 1e9, (now - last) / 1e9);
+        fflush(stdout);
+        if (done)
+            break;
+        last_sent = sent;
+        last_received = received;
+        last = now;
+    }
+
+    printf("Channel closed: %llu messages, %llu bytes sent, %llu messages received, blocked %llu times sending, %llu times receiving\n",
+           (unsigned long long)sent.messages, (unsigned long long)sent.bytes, (unsigned long long)received.messages,
+           (unsigned long long)sent.blocked, (unsigned long long)received.blocked);
+    munmap(page, sizeof(stats_page_t));
+    return 0;
+}
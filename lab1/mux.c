@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/epoll.h>
+
+#include "mux.h"
+
+/**
+ * @brief Open every channel of spec, a comma separated list of name or name:weight
+ *
+ * @param defaults Mailbox settings every channel starts from
+ * @return int
+ * Return 0 on success, -1 on error
+ */
+int mux_open(mux_t *mux, const transport_t *transport, const char *spec, const mailbox_t *defaults)
+{
+    char *saveptr, *name;
+
+    if (transport->watch == NULL) {
+        fprintf(stderr, "%s: cannot be multiplexed, use mq, eventfd or ring with -w eventfd\n", transport->name);
+        return -1;
+    }
+
+    memset(mux, 0, sizeof(*mux));
+    mux->names = strdup(spec);
+    mux->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (mux->epoll_fd == -1) {
+        perror("epoll_create1");
+        return -1;
+    }
+
+    for (name = strtok_r(mux->names, ",", &saveptr); name != NULL; name = strtok_r(NULL, ",", &saveptr)) {
+        channel_t *channel;
+        char *weight = strchr(name, ':');
+
+        mux->channels = realloc(mux->channels, (mux->count + 1) * sizeof(channel_t));
+        if (mux->channels == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        channel = &mux->channels[mux->count++];
+        memcpy(&channel->mailbox, defaults, sizeof(mailbox_t));
+        if (weight != NULL)
+            *weight++ = '\0';
+        channel->mailbox.channel = name;
+        channel->weight = weight != NULL && atoi(weight) > 0 ? atoi(weight) : 1;
+        channel->active = 1;
+        channel->done = 0;
+
+        mailbox_t *mailbox_ptr = &channel->mailbox;
+        if (transport->open(mailbox_ptr, ROLE_RECEIVER) == -1 || transport_open_stats(mailbox_ptr, ROLE_RECEIVER) == -1)
+            return -1;
+        transport_post_ready(mailbox_ptr);
+
+        struct epoll_event event = {.events = EPOLLIN};
+        int fd = transport->watch(mailbox_ptr);
+        if (fd == -1) {
+            fprintf(stderr, "%s: the sender has to use -w eventfd for this channel to be multiplexed\n", name);
+            return -1;
+        }
+        // The index, not a pointer, the array may still move
+        event.data.u32 = mux->count - 1;
+        if (epoll_ctl(mux->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+            perror("epoll_ctl");
+            return -1;
+        }
+    }
+    mux->live = mux->count;
+    mux->budget = mux->count > 0 ? mux->channels[0].weight : 0;
+    return mux->count > 0 ? 0 : -1;
+}
+
+/**
+ * @brief Block until a watched descriptor fires and mark its channels active again
+ */
+static void mux_wait(mux_t *mux)
+{
+    struct epoll_event events[64];
+    int n;
+
+    mux->wakeups++;
+    do {
+        n = epoll_wait(mux->epoll_fd, events, 64, -1);
+    } while (n == -1 && errno == EINTR);
+    if (n == -1)
+        perror("epoll_wait");
+
+    for (int i = 0; i < n; ++i) {
+        channel_t *channel = &mux->channels[events[i].data.u32];
+        channel->active = channel->mailbox.transport->ready(&channel->mailbox, 1) || channel->mailbox.batch.pending;
+    }
+}
+
+/**
+ * @brief The channel exited, it leaves the epoll set and is closed
+ */
+static void mux_retire(mux_t *mux, channel_t *channel)
+{
+    mailbox_t *mailbox_ptr = &channel->mailbox;
+
+    epoll_ctl(mux->epoll_fd, EPOLL_CTL_DEL, mailbox_ptr->transport->watch(mailbox_ptr), NULL);
+    mailbox_ptr->transport->close(mailbox_ptr, ROLE_RECEIVER);
+    transport_close_stats(mailbox_ptr);
+    channel->done = 1;
+    channel->active = 0;
+    mux->live--;
+}
+
+/**
+ * @brief The next message of any channel, taken in weighted round-robin order among those that have one
+ *
+ * @param channel_ptr Set to the channel it came from
+ * @return const char*
+ * Return the payload, valid until mux_release(), NULL once every channel's sender has exited
+ */
+const char* mux_peek(mux_t *mux, unsigned short *length_ptr, channel_t **channel_ptr)
+{
+    for (;;) {
+        channel_t *channel = &mux->channels[mux->current];
+        mailbox_t *mailbox_ptr = &channel->mailbox;
+
+        if (mux->budget > 0 && channel->active) {
+            // Records left in the current frame, or a frame the transport can hand over right away
+            if (mailbox_ptr->batch.pending != NULL || mailbox_ptr->transport->ready(mailbox_ptr, 0)) {
+                const char *text = peek(mailbox_ptr, length_ptr);
+                if (text != NULL) {
+                    mux->budget--;
+                    *channel_ptr = channel;
+                    return text;
+                }
+                mux_retire(mux, channel);
+            } else {
+                channel->active = 0;
+            }
+        }
+
+        if (mux->live == 0)
+            return NULL;
+
+        // Next channel that may have something, blocking once none may
+        unsigned int i;
+        for (i = 1; i <= mux->count; ++i)
+            if (mux->channels[(mux->current + i) % mux->count].active)
+                break;
+        if (i > mux->count) {
+            mux_wait(mux);
+            continue;
+        }
+        mux->current = (mux->current + i) % mux->count;
+        mux->budget = mux->channels[mux->current].weight;
+    }
+}
+
+/**
+ * @brief Step past the message returned by the last mux_peek()
+ */
+void mux_release(mux_t *mux)
+{
+    release(&mux->channels[mux->current].mailbox);
+}
+
+/**
+ * @brief Release the channel list and the epoll set, every channel was closed when it exited
+ */
+void mux_close(mux_t *mux)
+{
+    close(mux->epoll_fd);
+    free(mux->channels);
+    free(mux->names);
+}
@@ -0,0 +1,34 @@
+#ifndef MUX_H
+#define MUX_H
+
+#include "batch.h"
+
+/*
+ * One receiver serving many channels of the same transport, with one place to block:
+ * every channel's watched descriptor sits in an epoll set, and frames are taken from
+ * the channels that have them in weighted round-robin order, weight messages per turn.
+ */
+typedef struct {
+    mailbox_t mailbox;
+    unsigned int weight;          // messages taken per turn, at least 1
+    int active;                   // may have frames, cleared once found empty and set again when its descriptor fires
+    int done;                     // its sender has exited
+} channel_t;
+
+typedef struct {
+    channel_t *channels;
+    char *names;                  // the parsed spec, channel names point into it
+    unsigned int count;
+    unsigned int live;            // channels whose sender has not exited
+    unsigned int current;         // channel whose turn it is
+    unsigned int budget;          // messages it may still take this turn
+    int epoll_fd;
+    uint64_t wakeups;             // times every channel was empty and the receiver blocked
+} mux_t;
+
+int mux_open(mux_t *mux, const transport_t *transport, const char *spec, const mailbox_t *defaults);
+const char* mux_peek(mux_t *mux, unsigned short *length_ptr, channel_t **channel_ptr);
+void mux_release(mux_t *mux);
+void mux_close(mux_t *mux);
+
+#endif
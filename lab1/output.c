@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "output.h"
+
+/**
+ * @brief Write all of length bytes synchronously, at offset unless it is -1
+ */
+static int write_all(int fd, const char *data, size_t length, off_t offset)
+{
+    while (length > 0) {
+        ssize_t n = offset >= 0 ? pwrite(fd, data, length, offset) : write(fd, data, length);
+        if (n == -1) {
+            perror("write");
+            return -1;
+        }
+        data += n;
+        length -= n;
+        if (offset >= 0)
+            offset += n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Create the io_uring and map its rings, no liburing needed
+ *
+ * @return int
+ * Return 0 on success, -1 if io_uring is not available
+ */
+static int uring_setup(output_t *out)
+{
+    struct io_uring_params params;
+    int single_mmap;
+
+    memset(&params, 0, sizeof(params));
+    out->ring_fd = syscall(__NR_io_uring_setup, OUTPUT_BUFFERS, &params);
+    if (out->ring_fd == -1)
+        return -1;
+
+    out->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    out->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && out->cq_ring_size > out->sq_ring_size)
+        out->sq_ring_size = out->cq_ring_size;
+
+    out->sq_ring = mmap(NULL, out->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        out->ring_fd, IORING_OFF_SQ_RING);
+    if (out->sq_ring == MAP_FAILED)
+        goto fail;
+    out->cq_ring = single_mmap ? out->sq_ring :
+                   mmap(NULL, out->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        out->ring_fd, IORING_OFF_CQ_RING);
+    if (out->cq_ring == MAP_FAILED)
+        goto fail;
+    out->sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, out->ring_fd, IORING_OFF_SQES);
+    if (out->sqes == MAP_FAILED)
+        goto fail;
+
+    out->sq_head = (unsigned int *)((char *)out->sq_ring + params.sq_off.head);
+    out->sq_tail = (unsigned int *)((char *)out->sq_ring + params.sq_off.tail);
+    out->sq_mask = (unsigned int *)((char *)out->sq_ring + params.sq_off.ring_mask);
+    out->sq_array = (unsigned int *)((char *)out->sq_ring + params.sq_off.array);
+    out->cq_head = (unsigned int *)((char *)out->cq_ring + params.cq_off.head);
+    out->cq_tail = (unsigned int *)((char *)out->cq_ring + params.cq_off.tail);
+    out->cq_mask = (unsigned int *)((char *)out->cq_ring + params.cq_off.ring_mask);
+    out->cqes = (struct io_uring_cqe *)((char *)out->cq_ring + params.cq_off.cqes);
+    return 0;
+
+fail:
+    perror("io_uring mmap");
+    close(out->ring_fd);
+    out->ring_fd = -1;
+    return -1;
+}
+
+/**
+ * @brief Reap completions, waiting for at least min_complete of them
+ *
+ * A write the kernel failed, e.g. IORING_OP_WRITE before Linux 5.6, is done again with write()
+ * and the writer falls back to write() for good at the next buffer.
+ */
+static void uring_reap(output_t *out, unsigned int min_complete)
+{
+    if (min_complete > 0 &&
+        syscall(__NR_io_uring_enter, out->ring_fd, 0, min_complete, IORING_ENTER_GETEVENTS, NULL, 0) == -1)
+        perror("io_uring_enter");
+
+    unsigned int head = *out->cq_head;
+    while (head != __atomic_load_n(out->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &out->cqes[head & *out->cq_mask];
+        unsigned int i = cqe->user_data;
+        size_t written = cqe->res < 0 ? 0 : (size_t)cqe->res;
+
+        if (cqe->res < 0) {
+            fprintf(stderr, "io_uring write: %s, writing output synchronously\n", strerror(-cqe->res));
+            out->fallback = 1;
+        }
+        // Short or failed write, finish it here; with a single write in flight nothing can overtake it
+        if (written < out->used[i] &&
+            write_all(out->fd, out->buffers[i] + written, out->used[i] - written,
+                      out->offset >= 0 ? out->at[i] + (off_t)written : -1) == -1)
+            out->error = 1;
+        out->busy[i] = 0;
+        out->used[i] = 0;
+        out->inflight--;
+        head++;
+    }
+    __atomic_store_n(out->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Wait for the writes in flight, then tear the io_uring down so everything after goes through write()
+ */
+static void uring_stop(output_t *out)
+{
+    while (out->inflight > 0)
+        uring_reap(out, 1);
+    munmap(out->sqes, (*out->sq_mask + 1) * sizeof(struct io_uring_sqe));
+    if (out->cq_ring != out->sq_ring)
+        munmap(out->cq_ring, out->cq_ring_size);
+    munmap(out->sq_ring, out->sq_ring_size);
+    close(out->ring_fd);
+    out->ring_fd = -1;
+}
+
+/**
+ * @brief Write buffer i synchronously, at the writer's offset when it keeps one
+ */
+static void write_buffer(output_t *out, unsigned int i)
+{
+    if (write_all(out->fd, out->buffers[i], out->used[i], out->offset) == -1)
+        out->error = 1;
+    if (out->offset >= 0)
+        out->offset += out->used[i];
+    out->used[i] = 0;
+    out->writes++;
+}
+
+/**
+ * @brief Write buffer i out, through io_uring if there is one
+ */
+static void submit_buffer(output_t *out, unsigned int i)
+{
+    if (out->fallback && out->ring_fd != -1)
+        uring_stop(out);
+    if (out->ring_fd == -1) {
+        write_buffer(out, i);
+        return;
+    }
+
+    while (out->inflight >= out->max_inflight)
+        uring_reap(out, 1);
+    // A completion reaped just now may have failed
+    if (out->fallback) {
+        uring_stop(out);
+        write_buffer(out, i);
+        return;
+    }
+
+    unsigned int tail = *out->sq_tail;
+    unsigned int index = tail & *out->sq_mask;
+    struct io_uring_sqe *sqe = &out->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = out->fd;
+    sqe->addr = (unsigned long)out->buffers[i];
+    sqe->len = out->used[i];
+    sqe->off = out->offset >= 0 ? (uint64_t)out->offset : (uint64_t)-1;   // -1: the file position, for pipes and ttys
+    sqe->user_data = i;
+    out->sq_array[index] = index;
+    __atomic_store_n(out->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    // Not submitted, take the entry back and write the buffer here; nothing in flight is overtaken
+    // at an offset, and without one at most one write is in flight, which was just reaped
+    long submitted = syscall(__NR_io_uring_enter, out->ring_fd, 1, 0, 0, NULL, 0);
+    if (submitted != 1) {
+        if (submitted == -1)
+            perror("io_uring_enter");
+        else
+            fprintf(stderr, "io_uring_enter: write not submitted, writing output synchronously\n");
+        __atomic_store_n(out->sq_tail, tail, __ATOMIC_RELEASE);
+        out->fallback = 1;
+        write_buffer(out, i);
+        return;
+    }
+    out->busy[i] = 1;
+    out->inflight++;
+    out->writes++;
+    out->submitted++;
+    if (out->offset >= 0) {
+        out->at[i] = out->offset;
+        out->offset += out->used[i];
+    }
+}
+
+/**
+ * @brief Start writing to fd through io_uring
+ *
+ * @param out Writer to set up
+ * @param fd Where the output goes, its stdio buffer must be flushed first
+ * @return int
+ * Return 0 on success, -1 on error
+ */
+int output_open(output_t *out, int fd)
+{
+    struct stat st;
+    int flags = fcntl(fd, F_GETFL);
+
+    memset(out, 0, sizeof(*out));
+    out->fd = fd;
+
+    // Out of order completions are only safe at explicit offsets, O_APPEND would ignore them
+    out->offset = -1;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && flags != -1 && !(flags & O_APPEND))
+        out->offset = lseek(fd, 0, SEEK_CUR);
+    out->max_inflight = out->offset >= 0 ? OUTPUT_BUFFERS - 1 : 1;
+
+    for (unsigned int i = 0; i < OUTPUT_BUFFERS; ++i) {
+        out->buffers[i] = malloc(OUTPUT_BUFFER_SIZE);
+        if (out->buffers[i] == NULL) {
+            perror("malloc");
+            return -1;
+        }
+    }
+
+    if (uring_setup(out) == -1)
+        fprintf(stderr, "io_uring not available, writing output synchronously\n");
+    return 0;
+}
+
+/**
+ * @brief Space for length more bytes in the current buffer, handing full buffers to the kernel
+ *
+ * @param length At most OUTPUT_BUFFER_SIZE
+ */
+char* output_reserve(output_t *out, size_t length)
+{
+    if (out->used[out->current] + length > OUTPUT_BUFFER_SIZE) {
+        submit_buffer(out, out->current);
+        out->current = (out->current + 1) % OUTPUT_BUFFERS;
+        if (out->busy[out->current]) {
+            out->waits++;
+            while (out->busy[out->current])
+                uring_reap(out, 1);
+        }
+    }
+    return out->buffers[out->current] + out->used[out->current];
+}
+
+/**
+ * @brief Keep the first length bytes written to the last output_reserve()
+ */
+void output_commit(output_t *out, size_t length)
+{
+    out->used[out->current] += length;
+}
+
+/**
+ * @brief Write out what is left, wait for every write and release the writer
+ *
+ * @return int
+ * Return 0 if everything was written, -1 otherwise
+ */
+int output_close(output_t *out)
+{
+    if (out->used[out->current] > 0)
+        submit_buffer(out, out->current);
+
+    if (out->ring_fd != -1)
+        uring_stop(out);
+    // Leave the file position behind the output so later stdio writes follow it
+    if (out->offset >= 0)
+        lseek(out->fd, out->offset, SEEK_SET);
+
+    for (unsigned int i = 0; i < OUTPUT_BUFFERS; ++i)
+        free(out->buffers[i]);
+    return out->error ? -1 : 0;
+}
@@ -0,0 +1,48 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define OUTPUT_BUFFERS 4                 // buffers being filled or written, at most OUTPUT_BUFFERS - 1 in flight
+#define OUTPUT_BUFFER_SIZE (256 << 10)
+
+/*
+ * Coalescing writer for the receiver's output: lines are gathered in large buffers and each full
+ * buffer is written through io_uring while the next one fills, so persisting overlaps with receiving.
+ * Writes use explicit offsets when fd is a regular file opened without O_APPEND and may then complete
+ * in any order, otherwise only one is in flight so they land in submission order.
+ * Falls back to plain write() when io_uring is not available, or for the rest of the run once it fails a write.
+ */
+typedef struct {
+    int fd;
+    int ring_fd;                         // -1 when falling back to write()
+    int fallback;                        // io_uring failed a write, stop using it at the next buffer
+    off_t offset;                        // where the next buffer goes, -1 if fd is not seekable
+    unsigned int max_inflight;
+    unsigned int inflight;
+    unsigned int current;                // buffer being filled
+    size_t used[OUTPUT_BUFFERS];
+    int busy[OUTPUT_BUFFERS];            // submitted, completion not reaped yet
+    off_t at[OUTPUT_BUFFERS];            // offset each in-flight buffer was written at
+    char *buffers[OUTPUT_BUFFERS];
+    // io_uring rings, see io_uring_setup(2)
+    unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size;
+    uint64_t writes;                     // buffers written
+    uint64_t submitted;                  // of them through io_uring
+    uint64_t waits;                      // times the next buffer was still being written
+    int error;
+} output_t;
+
+int output_open(output_t *out, int fd);
+char* output_reserve(output_t *out, size_t length);
+void output_commit(output_t *out, size_t length);
+int output_close(output_t *out);
+
+#endif
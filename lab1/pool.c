@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+
+/**
+ * @brief Hand a slot back to the dispatcher
+ */
+static void pool_free(pool_t *pool, work_t *slot)
+{
+    atomic_store_explicit(&slot->state, WORK_FREE, memory_order_release);
+    atomic_fetch_add_explicit(&pool->freed, 1, memory_order_release);
+    waitpoint_wake(&pool->space);
+}
+
+/**
+ * @brief Ordered: emit every result whose turn it is, whoever holds the lock emits for the others too
+ *
+ * Each worker takes the lock after marking its result done, so a result is never left behind.
+ */
+static void pool_emit_due(pool_t *pool)
+{
+    pthread_mutex_lock(&pool->emit_lock);
+    for (;;) {
+        work_t *slot = &pool->slots[pool->emitted & (POOL_WINDOW - 1)];
+        if (pool->emitted == atomic_load_explicit(&pool->published, memory_order_acquire) ||
+            atomic_load_explicit(&slot->state, memory_order_acquire) != WORK_DONE)
+            break;
+        fwrite(slot->result, 1, slot->result_length, pool->out);
+        pool->emitted++;
+        pool_free(pool, slot);
+    }
+    pthread_mutex_unlock(&pool->emit_lock);
+}
+
+typedef struct {
+    pool_t *pool;
+    unsigned int index;
+} worker_arg_t;
+
+/**
+ * @brief Claim published messages one at a time until the pool is closed and drained
+ */
+static void* pool_worker(void *arg)
+{
+    pool_t *pool = ((worker_arg_t *)arg)->pool;
+    waitpoint_t *idle = &pool->idle[((worker_arg_t *)arg)->index];
+    unsigned long claim = atomic_load_explicit(&pool->claimed, memory_order_relaxed);
+
+    free(arg);
+    for (;;) {
+        // Read first, a publish or close after the checks below moves it and ends the wait
+        unsigned long events = atomic_load_explicit(&pool->events, memory_order_acquire);
+        unsigned long published = atomic_load_explicit(&pool->published, memory_order_acquire);
+
+        if (claim == published) {
+            // Closed is set after the last publish, so nothing published is missed once it is seen
+            if (atomic_load_explicit(&pool->closed, memory_order_acquire) &&
+                atomic_load_explicit(&pool->published, memory_order_acquire) == claim)
+                break;
+            // Counted before it re-checks events, so pool_signal() either sees it or it sees the signal
+            atomic_fetch_add(&pool->idlers, 1);
+            if (wait_while_equal(&pool->events, events, idle, WAIT_FUTEX, DEFAULT_SPIN_BUDGET) > 0)
+                atomic_fetch_add_explicit(&pool->sleeps, 1, memory_order_relaxed);
+            atomic_fetch_sub_explicit(&pool->idlers, 1, memory_order_relaxed);
+            claim = atomic_load_explicit(&pool->claimed, memory_order_relaxed);
+            continue;
+        }
+        // The CAS reloads claim if another worker took it first
+        if (!atomic_compare_exchange_weak_explicit(&pool->claimed, &claim, claim + 1,
+                                                   memory_order_acquire, memory_order_relaxed))
+            continue;
+
+        work_t *slot = &pool->slots[claim & (POOL_WINDOW - 1)];
+        slot->result_length = pool->work(slot->text, slot->length, slot->result);
+        if (pool->ordered) {
+            atomic_store_explicit(&slot->state, WORK_DONE, memory_order_release);
+            pool_emit_due(pool);
+        } else {
+            fwrite(slot->result, 1, slot->result_length, pool->out);
+            pool_free(pool, slot);
+        }
+        claim = atomic_load_explicit(&pool->claimed, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Tell idle workers something changed, nothing more than the bump while every worker is busy
+ */
+static void pool_signal(pool_t *pool)
+{
+    atomic_fetch_add_explicit(&pool->events, 1, memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&pool->idlers, memory_order_relaxed) == 0)
+        return;
+    for (unsigned int i = 0; i < pool->workers; ++i)
+        waitpoint_wake(&pool->idle[i]);
+}
+
+/**
+ * @brief Start the worker threads, each running work on the messages it claims, results go to out
+ *
+ * @param ordered Emit results in dispatch order rather than as they are ready
+ * @return int
+ * Return 0 on success, -1 on error
+ */
+int pool_open(pool_t *pool, unsigned int workers, int ordered, work_fn work, FILE *out)
+{
+    memset(pool, 0, sizeof(*pool));
+    pthread_mutex_init(&pool->emit_lock, NULL);
+    pool->work = work;
+    pool->out = out;
+    pool->ordered = ordered;
+    pool->workers = workers;
+
+    for (unsigned int i = 0; i < workers; ++i) {
+        worker_arg_t *arg = malloc(sizeof(worker_arg_t));
+        int error;
+
+        if (arg == NULL) {
+            perror("malloc");
+            return -1;
+        }
+        arg->pool = pool;
+        arg->index = i;
+        error = pthread_create(&pool->threads[i], NULL, pool_worker, arg);
+        if (error != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(error));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Copy a message into the next slot and publish it, waiting while the window is full
+ */
+void pool_dispatch(pool_t *pool, const char *text, unsigned short length)
+{
+    unsigned long seq = atomic_load_explicit(&pool->published, memory_order_relaxed);
+    work_t *slot = &pool->slots[seq & (POOL_WINDOW - 1)];
+
+    if (atomic_load_explicit(&slot->state, memory_order_acquire) != WORK_FREE) {
+        pool->waits++;
+        for (;;) {
+            // Read before checking, a slot freed after the check moves it and ends the wait
+            unsigned long freed = atomic_load_explicit(&pool->freed, memory_order_acquire);
+            if (atomic_load_explicit(&slot->state, memory_order_acquire) == WORK_FREE)
+                break;
+            wait_while_equal(&pool->freed, freed, &pool->space, WAIT_FUTEX, DEFAULT_SPIN_BUDGET);
+        }
+    }
+
+    memcpy(slot->text, text, length);
+    slot->length = length;
+    atomic_store_explicit(&slot->state, WORK_QUEUED, memory_order_relaxed);
+    atomic_store_explicit(&pool->published, seq + 1, memory_order_release);
+    pool_signal(pool);
+}
+
+/**
+ * @brief Let the workers finish what was dispatched, then stop them and print how the pool did
+ */
+void pool_close(pool_t *pool)
+{
+    atomic_store_explicit(&pool->closed, 1, memory_order_release);
+    pool_signal(pool);
+    for (unsigned int i = 0; i < pool->workers; ++i)
+        pthread_join(pool->threads[i], NULL);
+    fflush(pool->out);
+    pthread_mutex_destroy(&pool->emit_lock);
+
+    printf("Worker pool: %u workers, %llu messages %s, window of %d full %llu times, workers idle %llu times\n",
+           pool->workers, (unsigned long long)atomic_load(&pool->published),
+           pool->ordered ? "in order" : "as finished", POOL_WINDOW,
+           (unsigned long long)pool->waits, (unsigned long long)atomic_load(&pool->sleeps));
+}
@@ -0,0 +1,58 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "mailbox.h"
+
+#define POOL_WINDOW 256              // messages dispatched and not yet emitted, must be a power of two
+#define POOL_MAX_WORKERS 64
+#define POOL_RESULT_SIZE (MAX_MESSAGE_SIZE + 64)
+
+#define WORK_FREE 0                  // work_t.state: the dispatcher may fill it
+#define WORK_QUEUED 1                // holds a message for a worker
+#define WORK_DONE 2                  // holds a result waiting for its turn to be emitted
+
+/*
+ * Receiver-side worker pool: the IPC thread copies each message into the next slot of a window
+ * and publishes it, workers claim slots with a compare-and-swap on a shared counter, so the queue
+ * between them takes no lock. Each worker turns its message into a result with the pool's work
+ * function and emits it, right away when unordered, otherwise once every earlier result has been.
+ */
+typedef size_t (*work_fn)(const char *text, unsigned short length, char *result);
+
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_uint state;   // WORK_FREE, WORK_QUEUED or WORK_DONE
+    unsigned short length;
+    size_t result_length;
+    char text[MAX_MESSAGE_SIZE];
+    char result[POOL_RESULT_SIZE];
+} work_t;
+
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong published;   // messages dispatched
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong claimed;     // messages taken by a worker
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong freed;       // slots handed back, what the dispatcher waits on
+    waitpoint_t space;                                   // the dispatcher sleeps here while the window is full
+    atomic_uint closed;                                  // nothing more will be dispatched
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong events;      // bumped on every publish and on close, what idle workers wait on
+    atomic_uint idlers;                                  // workers about to wait or waiting on events
+    waitpoint_t idle[POOL_MAX_WORKERS];                  // each worker sleeps on its own while nothing is published
+    work_t slots[POOL_WINDOW];
+    pthread_mutex_t emit_lock;                           // ordered: held while emitting the results due
+    uint64_t emitted;                                    // ordered: results emitted, under emit_lock
+    work_fn work;
+    FILE *out;
+    int ordered;
+    unsigned int workers;
+    pthread_t threads[POOL_MAX_WORKERS];
+    uint64_t waits;                                      // times the window was full
+    atomic_ulong sleeps;                                 // times a worker found nothing to do and slept
+} pool_t;
+
+int pool_open(pool_t *pool, unsigned int workers, int ordered, work_fn work, FILE *out);
+void pool_dispatch(pool_t *pool, const char *text, unsigned short length);
+void pool_close(pool_t *pool);
+
+#endif
@@ -1,126 +1,323 @@
 #include "receiver.h"
 
-double time_taken = 0.0;
+_Thread_local double time_taken = 0.0;
 
 void receive(message_t* message_ptr, mailbox_t* mailbox_ptr){
     /*  TODO: 
         1. Use flag to determine the communication method
         2. According to the communication method, receive the message
     */
-    struct timespec start, end;
-    
-    sem_post(mailbox_ptr->sem_receive);
-    sem_wait(mailbox_ptr->sem_send);
-    
-    if (mailbox_ptr->flag == 1) {
-        // Message passing using POSIX message queue
-        clock_gettime(CLOCK_MONOTONIC, &start);
-        mq_receive(mailbox_ptr->storage.mqd, message_ptr->msg_text, MAX_MESSAGE_SIZE, NULL);
-        clock_gettime(CLOCK_MONOTONIC, &end);
-        time_taken += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
-        
-    } else if (mailbox_ptr->flag == 2) {
-        clock_gettime(CLOCK_MONOTONIC, &start);
-        //strncpy(message_ptr->msg_text, mailbox_ptr->storage.shm_addr, MAX_MESSAGE_SIZE);
-        strcpy(message_ptr->msg_text, mailbox_ptr->storage.shm_addr);
-        clock_gettime(CLOCK_MONOTONIC, &end);
-        time_taken += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
-        
+    unsigned short length;
+    const char *text = peek(mailbox_ptr, &length);
+
+    if (text == NULL) {
+        message_ptr->type = MSG_EXIT;
+        message_ptr->length = 0;
+        return;
+    }
+
+    memcpy(message_ptr->msg_text, text, length);
+    message_ptr->type = MSG_DATA;
+    message_ptr->length = length;
+    message_ptr->stamp = peek_record(text).stamp;
+    message_ptr->id = peek_record(text).id;
+    message_ptr->priority = peek_priority(mailbox_ptr);
+    release(mailbox_ptr);
+}
+
+/**
+ * @brief The worker pool's work: the line the receiver prints for a message
+ *
+ * @return size_t
+ * Return the length of the line written to result
+ */
+static size_t format_line(const char *text, unsigned short length, char *result)
+{
+    static const char prefix[] = "Receiving message: ";
+
+    memcpy(result, prefix, sizeof(prefix) - 1);
+    memcpy(result + sizeof(prefix) - 1, text, length);
+    result[sizeof(prefix) - 1 + length] = '\n';
+    return sizeof(prefix) + length;
+}
+
+/**
+ * @brief Serve every channel of spec from one wait point, until all their senders have exited
+ *
+ * @param defaults Mailbox every channel is opened from, each with its own name
+ * @return int
+ * Return 0 on success, -1 on error
+ */
+static int receive_channels(const mailbox_t *defaults, const char *spec)
+{
+    mux_t mux;
+    channel_t *channel;
+    const char *text;
+    unsigned short length;
+
+    if (mux_open(&mux, defaults->transport, spec, defaults) == -1)
+        return -1;
+    printf("%s\n", defaults->transport->label);
+    printf("Serving %u channels:", mux.count);
+    for (unsigned int i = 0; i < mux.count; ++i)
+        printf(" %s (weight %u)", mux.channels[i].mailbox.channel, mux.channels[i].weight);
+    printf("\n");
+
+    /* Messages from whichever channel's turn it is, NULL once every sender has exited */
+    while ((text = mux_peek(&mux, &length, &channel)) != NULL) {
+        printf("Receiving message on %s: %.*s\n", channel->mailbox.channel, length, text);
+        mux_release(&mux);
+    }
+    printf("All senders exit!\n");
+    printf("Total time taken in receiving msg: %.6fs\n", time_taken);
+    printf("Blocked %llu times with every channel empty\n", (unsigned long long)mux.wakeups);
+
+    /* Each channel's figures, its transport was closed when its sender exited */
+    for (unsigned int i = 0; i < mux.count; ++i) {
+        mailbox_t *mailbox_ptr = &mux.channels[i].mailbox;
+        char label[NAME_MAX];
+
+        snprintf(label, sizeof(label), "Channel %s", mailbox_ptr->channel);
+        print_throughput(label, mailbox_ptr->messages, mailbox_ptr->bytes, now_ns() - mailbox_ptr->first_ns);
+        print_latency(label, &mailbox_ptr->latency);
+        if (mailbox_ptr->transport->stats)
+            mailbox_ptr->transport->stats(mailbox_ptr, ROLE_RECEIVER);
     }
+    mux_close(&mux);
+    return 0;
 }
 
 int main(int argc, char *argv[]){
     /*  TODO: 
-        1) Call receive(&message, &mailbox) according to the flow in slide 4
+        1) Call receive(&message, &mailbox) (or peek/release) according to the flow in slide 4
         2) Measure the total receiving time
         3) Get the mechanism from command line arguments
             • e.g. ./receiver 1
+                    (5 and 10 stream the sender's whole input file, see -o)
         4) Print information on the console according to the output format
         5) If the exit message is received, print the total receiving time and terminate the receiver.c
     */
-    if (argc != 2) {
-        printf("Usage: ./receiver <mechanism>\n");
+    // Ring and MPMC spin budget, for the ring taken from the sender unless overridden here
+    unsigned int spin_budget = SPIN_BUDGET_UNSET;
+    // Where mechanisms 5 and 10 write the streamed payload, discarded if not given
+    char *output_file = NULL;
+    // Print through stdio unless -u asks for coalesced io_uring writes
+    int uring_output = 0;
+    int output_lost = 0;
+    // Where the sender may have put the segment with -H, CPU to stay on with -C
+    char *huge_dir = NULL;
+    int cpu = -1;
+    // Answer every message on the reply channel of a sender started with -R
+    int rpc = 0;
+    // Channels to serve at once with -N name[:weight],..., a single unnamed one by default
+    char *channels = NULL;
+    // Print in the order the sender numbered the messages with -O, as they arrive otherwise
+    int ordered = 0;
+    // Worker threads formatting the messages with -W, in arrival order unless -A
+    unsigned int workers = 0;
+    int as_finished = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:o:uH:C:RN:OW:A")) != -1) {
+        switch (opt) {
+        case 'W':
+            workers = atoi(optarg);
+            if (workers == 0 || workers > POOL_MAX_WORKERS)
+                argc = -1;
+            break;
+        case 'A':
+            as_finished = 1;
+            break;
+        case 'O':
+            ordered = 1;
+            break;
+        case 'N':
+            channels = optarg;
+            break;
+        case 'R':
+            rpc = 1;
+            break;
+        case 'H':
+            huge_dir = optarg;
+            break;
+        case 'C':
+            cpu = atoi(optarg);
+            break;
+        case 'u':
+            uring_output = 1;
+            break;
+        case 'n':
+            spin_budget = atoi(optarg);
+            break;
+        case 'o':
+            output_file = optarg;
+            break;
+        default:
+            argc = -1;
+        }
+    }
+
+    const transport_t *transport = argc - optind == 1 ? transport_find(argv[optind]) : NULL;
+
+    if (transport == NULL) {
+        printf("Usage: ./receiver [-n spin_budget] [-o output_file] [-u] [-H hugetlbfs_dir] [-C cpu] [-R] [-N channel[:weight],...] [-O] [-W workers [-A]] <mechanism>\n");
+        transport_usage(stdout);
         return -1;
     }
+    // Byte streams have no records to answer
+    if (rpc && transport->recv == NULL) {
+        fprintf(stderr, "-R needs a frame transport\n");
+        return -1;
+    }
+    // Replies and io_uring output are set up for one channel
+    if (channels != NULL && (rpc || uring_output)) {
+        fprintf(stderr, "-N cannot be combined with -R or -u\n");
+        return -1;
+    }
+    // Only the stdio loop and the pool below reorder, streams have no ids to reorder by
+    if (ordered && (transport->recv == NULL || uring_output || channels != NULL)) {
+        fprintf(stderr, "-O needs a frame transport and no -u or -N\n");
+        return -1;
+    }
+    // The pool has an output path of its own, -O reorders in front of it, which -A would undo
+    if (workers > 0 && (transport->recv == NULL || rpc || uring_output || channels != NULL || (ordered && as_finished))) {
+        fprintf(stderr, "-W needs a frame transport and no -R, -u, -N or -O with -A\n");
+        return -1;
+    }
+    // Overwritten values are never delivered, their requests would go unanswered and their gaps unfilled
+    if ((rpc || ordered) && transport == &transport_seqlock) {
+        fprintf(stderr, "-R and -O need every message, %s skips overwritten ones\n", transport->name);
+        return -1;
+    }
+
+    // Initialize mailbox, static so no frame is pending
+    static mailbox_t mailbox;
+    mailbox.flag = transport->id;
+    mailbox.transport = transport;
+    mailbox.spin_budget = spin_budget;
+    mailbox.huge_dir = huge_dir;
+
+    if (cpu >= 0 && pin_to_cpu(cpu) == -1)
+        return -1;
+
+    if (channels != NULL)
+        return receive_channels(&mailbox, channels);
+
+    static mailbox_t replies;
 
-    int mechanism = atoi(argv[1]);
+    if (mailbox.transport->open(&mailbox, ROLE_RECEIVER) == -1 || transport_open_stats(&mailbox, ROLE_RECEIVER) == -1)
+        return -1;
+    if (rpc && rpc_server_open(&replies, &mailbox) == -1)
+        return -1;
+    // Every sender numbers its messages from 0, with several of them the ids collide
+    if (ordered && transport == &transport_mpmc && mailbox.storage.mpmc->producers > 1) {
+        fprintf(stderr, "-O needs a single sender, the queue has %u\n", mailbox.storage.mpmc->producers);
+        return -1;
+    }
+    transport_post_ready(&mailbox);
+    printf("%s\n", mailbox.transport->label);
+    if (mailbox.segment_huge)
+        printf("Segment on huge pages in %s\n", huge_dir);
+    if (cpu >= 0)
+        printf("Pinned to CPU %d\n", cpu);
 
-    // Initialize mailbox
-    mailbox_t mailbox;
-    mailbox.flag = mechanism;
+    if (mailbox.transport->recv_file) {
+        // A checksum mismatch or a failed write means the file did not arrive whole
+        if (mailbox.transport->recv_file(&mailbox, output_file) == -1)
+            output_lost = 1;
+    } else if (workers > 0) {
+        // This thread only moves messages into the pool, the workers format and print them.
+        // With -O they go in by id, and the ordered pool emits them in the order they went in.
+        static pool_t pool;
+        const char *text;
+        unsigned short length;
+        reorder_t order;
 
-    if (mechanism == 1) {
-        // POSIX message queue setup
-        mailbox.storage.mqd = mq_open("/msg_queue", O_CREAT | O_RDONLY, 0666, NULL);
-        mailbox.sem_send = sem_open("sender", 0);
-        mailbox.sem_receive = sem_open("receiver", 0);
-        if (mailbox.storage.mqd == (mqd_t)-1) {
-            perror("mq_open");
+        fflush(stdout);
+        if (ordered && reorder_open(&order) == -1)
             return -1;
-        }
-        if (mailbox.sem_send == SEM_FAILED || mailbox.sem_receive == SEM_FAILED) {
-            perror("sem_open");
+        if (pool_open(&pool, workers, !as_finished, format_line, stdout) == -1)
             return -1;
+        while ((text = peek(&mailbox, &length)) != NULL) {
+            if (!ordered || reorder_admit(&order, peek_record(text).id, text, length))
+                pool_dispatch(&pool, text, length);
+            release(&mailbox);
+            for (char *held; ordered && (held = reorder_pop(&order, &length)) != NULL; free(held))
+                pool_dispatch(&pool, held, length);
         }
-        printf("Message Passing\n");
-    } else if (mechanism == 2) {
-        // POSIX shared memory setup
-        int shm_fd = shm_open("/shm_memory", O_CREAT | O_RDONLY, 0666);
-        mailbox.sem_send = sem_open("sender", 0);
-        mailbox.sem_receive = sem_open("receiver", 0);
-        if (shm_fd == -1) {
-            perror("shm_open");
-            return -1;
+        pool_close(&pool);
+        if (ordered) {
+            printf("Reordered: %llu messages arrived early, at most %llu held at once\n",
+                   (unsigned long long)order.early, (unsigned long long)order.max_held);
+            reorder_close(&order);
         }
-        if (mailbox.sem_send == SEM_FAILED || mailbox.sem_receive == SEM_FAILED) {
-            perror("sem_open");
+    } else if (uring_output) {
+        // Same lines as below, gathered into large buffers that are written while the next fills
+        static const char prefix[] = "Receiving message: ";
+        output_t output;
+        const char *text;
+        unsigned short length;
+
+        fflush(stdout);
+        if (output_open(&output, STDOUT_FILENO) == -1)
             return -1;
+        while ((text = peek(&mailbox, &length)) != NULL) {
+            char *line = output_reserve(&output, sizeof(prefix) + length);
+            memcpy(line, prefix, sizeof(prefix) - 1);
+            memcpy(line + sizeof(prefix) - 1, text, length);
+            line[sizeof(prefix) - 1 + length] = '\n';
+            output_commit(&output, sizeof(prefix) + length);
+            if (rpc)
+                rpc_reply(&replies, text, length);
+            release(&mailbox);
         }
-        // Map shared memory
-        mailbox.storage.shm_addr = mmap(NULL, MAX_MESSAGE_SIZE, PROT_READ, MAP_SHARED, shm_fd, 0);
-        if (mailbox.storage.shm_addr == MAP_FAILED) {
-            perror("mmap");
+        if (output_close(&output) == -1)
+            output_lost = 1;
+        printf("Output: %llu writes of up to %u KB, %llu through io_uring, %llu waits for a free buffer\n",
+               (unsigned long long)output.writes, OUTPUT_BUFFER_SIZE >> 10, (unsigned long long)output.submitted,
+               (unsigned long long)output.waits);
+    } else {
+        // Read every message where it lies, peek() returns NULL on the exit message
+        const char *text;
+        unsigned short length;
+        reorder_t order;
+
+        if (ordered && reorder_open(&order) == -1)
             return -1;
+        while ((text = peek(&mailbox, &length)) != NULL) {
+            // An early message waits in the reorder stage, then goes out once the ones before it have
+            if (!ordered || reorder_admit(&order, peek_record(text).id, text, length))
+                printf("Receiving message: %.*s\n", length, text);
+            if (rpc)
+                rpc_reply(&replies, text, length);
+            release(&mailbox);
+            for (char *held; ordered && (held = reorder_pop(&order, &length)) != NULL; free(held))
+                printf("Receiving message: %.*s\n", length, held);
         }
-        
-        
-        printf("Share Memory\n");
-    }
-    
-    
-    message_t message;
-    while (1) {
-        // Receive message
-        receive(&message, &mailbox);
-        if (strcmp(message.msg_text, "exit") == 0) {
-            break;
+        if (ordered) {
+            printf("Reordered: %llu messages arrived early, at most %llu held at once\n",
+                   (unsigned long long)order.early, (unsigned long long)order.max_held);
+            reorder_close(&order);
         }
-            
-        printf("Receiving message: %s\n", message.msg_text);
     }
     printf("Sender exit!\n");
+    if (rpc)
+        rpc_server_close(&replies);
     printf("Total time taken in receiving msg: %.6fs\n", time_taken);
+    print_throughput("Receiver", mailbox.messages, mailbox.bytes, now_ns() - mailbox.first_ns);
+    print_latency("End-to-end", &mailbox.latency);
+
+    if (mailbox.transport->stats)
+        mailbox.transport->stats(&mailbox, ROLE_RECEIVER);
 
     // Cleanup
-    if (mechanism == 1) {
-        mq_close(mailbox.storage.mqd);
-        mq_unlink("/msg_queue");
-        sem_close(mailbox.sem_send); 
-        sem_close(mailbox.sem_receive);
-        sem_unlink("/sender");
-        sem_unlink("/receiver");
-        
-    } else if (mechanism == 2) {
-        munmap(mailbox.storage.shm_addr, MAX_MESSAGE_SIZE);
-        shm_unlink("/shm_memory");
-        sem_close(mailbox.sem_send);
-        sem_close(mailbox.sem_receive);
-        sem_unlink("/sender");
-        sem_unlink("/receiver");
-    } else {
-        perror("argv[1]");
+    mailbox.transport->close(&mailbox, ROLE_RECEIVER);
+    transport_close_stats(&mailbox);
+
+    // Exit non-zero when some of the output could not be written or did not arrive intact
+    if (output_lost) {
+        fprintf(stderr, "Some of the output was lost\n");
         return -1;
     }
-
     return 0;
 }
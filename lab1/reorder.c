@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reorder.h"
+
+/**
+ * @brief Start with nothing held and the message numbered 0 due
+ *
+ * @return int
+ * Return 0 on success, -1 on error
+ */
+int reorder_open(reorder_t *order)
+{
+    memset(order, 0, sizeof(*order));
+    order->capacity = REORDER_SLOTS;
+    order->slots = calloc(order->capacity, sizeof(held_t));
+    if (order->slots == NULL) {
+        perror("calloc");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Make room for ids up to id, moving the held messages to their place in the larger table
+ */
+static int reorder_grow(reorder_t *order, uint64_t id)
+{
+    uint64_t capacity = order->capacity;
+    held_t *slots;
+
+    while (id - order->next >= capacity)
+        capacity <<= 1;
+    slots = calloc(capacity, sizeof(held_t));
+    if (slots == NULL) {
+        perror("calloc");
+        return -1;
+    }
+    for (uint64_t i = 0; i < order->capacity; ++i)
+        if (order->slots[i].text != NULL)
+            slots[order->slots[i].id & (capacity - 1)] = order->slots[i];
+    free(order->slots);
+    order->slots = slots;
+    order->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Take in the message numbered id, holding a copy of it if it is early
+ *
+ * @return int
+ * Return 1 if the caller delivers it now, 0 if it is held for reorder_pop()
+ */
+int reorder_admit(reorder_t *order, uint64_t id, const char *text, unsigned short length)
+{
+    // Due, or an id seen before, which no later message waits for
+    if (id <= order->next) {
+        if (id == order->next)
+            order->next++;
+        return 1;
+    }
+    if (id - order->next >= order->capacity && reorder_grow(order, id) == -1)
+        return 1;
+
+    held_t *slot = &order->slots[id & (order->capacity - 1)];
+    if (slot->text != NULL)
+        return 1;
+    slot->text = malloc(length > 0 ? length : 1);
+    if (slot->text == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    memcpy(slot->text, text, length);
+    slot->id = id;
+    slot->length = length;
+    order->early++;
+    if (++order->held > order->max_held)
+        order->max_held = order->held;
+    return 0;
+}
+
+/**
+ * @brief The held message whose turn it is now
+ *
+ * @return char*
+ * Return the message, freed by the caller, NULL while the next one has not arrived
+ */
+char *reorder_pop(reorder_t *order, unsigned short *length_ptr)
+{
+    held_t *slot = &order->slots[order->next & (order->capacity - 1)];
+    char *text = slot->text;
+
+    if (text == NULL || slot->id != order->next)
+        return NULL;
+    slot->text = NULL;
+    order->held--;
+    order->next++;
+    *length_ptr = slot->length;
+    return text;
+}
+
+/**
+ * @brief Report messages still held, which only happens if the sender skipped ids, and free them
+ */
+void reorder_close(reorder_t *order)
+{
+    if (order->held > 0)
+        fprintf(stderr, "reorder: %llu messages never delivered, message %llu did not arrive\n",
+                (unsigned long long)order->held, (unsigned long long)order->next);
+    for (uint64_t i = 0; i < order->capacity; ++i)
+        free(order->slots[i].text);
+    free(order->slots);
+}
@@ -0,0 +1,33 @@
+#ifndef REORDER_H
+#define REORDER_H
+
+#include <stdint.h>
+
+#define REORDER_SLOTS 64                 // held messages to start with, doubled whenever a gap is wider
+
+/*
+ * Reorder stage for the receiver: messages arriving ahead of their turn, by the id the sender numbered
+ * them with, are copied aside until every message before them has been delivered.
+ * Messages that arrive in turn are never copied.
+ */
+typedef struct {
+    uint64_t id;
+    unsigned short length;
+    char *text;                          // NULL while the slot is free
+} held_t;
+
+typedef struct {
+    uint64_t next;                       // id to deliver next
+    held_t *slots;                       // a held message sits at slots[id & (capacity - 1)]
+    uint64_t capacity;                   // a power of two
+    uint64_t held;
+    uint64_t max_held;
+    uint64_t early;                      // messages that arrived ahead of their turn
+} reorder_t;
+
+int reorder_open(reorder_t *order);
+int reorder_admit(reorder_t *order, uint64_t id, const char *text, unsigned short length);
+char *reorder_pop(reorder_t *order, unsigned short *length_ptr);
+void reorder_close(reorder_t *order);
+
+#endif
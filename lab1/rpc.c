@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <fcntl.h>
+
+#include "rpc.h"
+
+/**
+ * @brief Mailbox for the reply ring, the same on both ends apart from the role it is opened with
+ */
+static void reply_mailbox(mailbox_t *replies, const char *huge_dir)
+{
+    replies->flag = transport_ring.id;
+    replies->transport = &transport_ring;
+    replies->channel = RPC_CHANNEL;
+    replies->huge_dir = huge_dir;
+    // One reply per frame, the sender is waiting for it
+    replies->batch.max_count = 1;
+    replies->batch.max_bytes = FRAME_SIZE;
+    replies->wait_strategy = WAIT_FUTEX;
+    replies->spin_budget = DEFAULT_SPIN_BUDGET;
+}
+
+/**
+ * @brief Match each reply to its request and free its place in the window, until the receiver exits
+ */
+static void* reply_thread(void *arg)
+{
+    rpc_t *rpc = arg;
+    const char *text;
+    unsigned short length;
+
+    while ((text = peek(&rpc->replies, &length)) != NULL) {
+        record_t reply = peek_record(text);
+        rpc_call_t *call = &rpc->calls[reply.id % rpc->window];
+
+        if (atomic_load_explicit(&call->id, memory_order_relaxed) == reply.id && call->length == length) {
+            histogram_record(&rpc->round_trip, now_ns() - call->stamp);
+            atomic_store_explicit(&call->id, UINT64_MAX, memory_order_relaxed);
+        } else {
+            rpc->unmatched++;
+        }
+        release(&rpc->replies);
+
+        atomic_fetch_add_explicit(&rpc->answered, 1, memory_order_release);
+        waitpoint_wake(&rpc->space);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Sender: get ready for replies, before the request channel is opened so the receiver never sees a stale RPC_READY
+ *
+ * @param window Requests that may be outstanding
+ * @return int
+ * Return 0 on success, -1 on error
+ */
+int rpc_client_open(rpc_t *rpc, unsigned int window)
+{
+    rpc->window = window;
+    rpc->calls = malloc(window * sizeof(rpc_call_t));
+    if (rpc->calls == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    for (unsigned int i = 0; i < window; ++i)
+        atomic_init(&rpc->calls[i].id, UINT64_MAX);
+
+    sem_unlink(RPC_READY);
+    rpc->ready = sem_open(RPC_READY, O_CREAT, 0666, 0);
+    if (rpc->ready == SEM_FAILED) {
+        perror("sem_open");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Sender: once the request channel is open, wait for the receiver's reply ring and start draining it
+ *
+ * @return int
+ * Return 0 on success, -1 on error
+ */
+int rpc_client_start(rpc_t *rpc, mailbox_t *requests)
+{
+    int error;
+
+    sem_wait(rpc->ready);
+    sem_close(rpc->ready);
+    sem_unlink(RPC_READY);
+
+    reply_mailbox(&rpc->replies, requests->huge_dir);
+    rpc->replies.spin_budget = SPIN_BUDGET_UNSET;
+    if (rpc->replies.transport->open(&rpc->replies, ROLE_RECEIVER) == -1)
+        return -1;
+
+    error = pthread_create(&rpc->thread, NULL, reply_thread, rpc);
+    if (error != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(error));
+        return -1;
+    }
+    requests->rpc = rpc;
+    return 0;
+}
+
+/**
+ * @brief Sender: block while window requests are unanswered, sending the pending ones first so they can be
+ *
+ * Replies may come back out of order (-p lets urgent requests overtake), so the window having room
+ * is not enough: the slot of the next id must also be free, or its unanswered request would be overwritten.
+ */
+void rpc_wait_window(mailbox_t *requests)
+{
+    rpc_t *rpc = requests->rpc;
+    rpc_call_t *call = &rpc->calls[requests->messages % rpc->window];
+    unsigned long answered = atomic_load_explicit(&rpc->answered, memory_order_acquire);
+
+    // The reply thread frees the slot before it counts the reply, so reading answered first is enough
+    if (rpc->sent - answered < rpc->window && atomic_load_explicit(&call->id, memory_order_relaxed) == UINT64_MAX)
+        return;
+
+    rpc->full++;
+    flush(requests);
+    while (rpc->sent - answered >= rpc->window || atomic_load_explicit(&call->id, memory_order_relaxed) != UINT64_MAX) {
+        wait_while_equal(&rpc->answered, answered, &rpc->space, WAIT_FUTEX, DEFAULT_SPIN_BUDGET);
+        answered = atomic_load_explicit(&rpc->answered, memory_order_acquire);
+    }
+}
+
+/**
+ * @brief Sender: remember a request being committed until its reply comes back
+ */
+void rpc_track(rpc_t *rpc, const record_t *record)
+{
+    rpc_call_t *call = &rpc->calls[record->id % rpc->window];
+
+    atomic_store_explicit(&call->id, record->id, memory_order_relaxed);
+    call->stamp = record->stamp;
+    call->length = record->length;
+    rpc->sent++;
+}
+
+/**
+ * @brief Sender: after the exit message went out, wait for the last replies and print the round trips
+ */
+void rpc_client_close(rpc_t *rpc)
+{
+    pthread_join(rpc->thread, NULL);
+    rpc->replies.transport->close(&rpc->replies, ROLE_RECEIVER);
+
+    printf("RPC: %llu requests, %llu replies, %llu unmatched, window of %u full %llu times\n",
+           (unsigned long long)rpc->sent, (unsigned long long)atomic_load(&rpc->answered),
+           (unsigned long long)rpc->unmatched, rpc->window, (unsigned long long)rpc->full);
+    print_latency("Round-trip", &rpc->round_trip);
+    free(rpc->calls);
+}
+
+/**
+ * @brief Receiver: set up the reply ring and tell the sender it can attach
+ *
+ * @return int
+ * Return 0 on success, -1 on error
+ */
+int rpc_server_open(mailbox_t *replies, const mailbox_t *requests)
+{
+    sem_t *ready;
+
+    reply_mailbox(replies, requests->huge_dir);
+    if (replies->transport->open(replies, ROLE_SENDER) == -1)
+        return -1;
+
+    ready = sem_open(RPC_READY, 0);
+    if (ready == SEM_FAILED) {
+        perror("sem_open " RPC_READY);
+        return -1;
+    }
+    sem_post(ready);
+    sem_close(ready);
+    return 0;
+}
+
+/**
+ * @brief Receiver: answer the request peek() returned with an echo of it
+ */
+void rpc_reply(mailbox_t *replies, const char *text, unsigned short length)
+{
+    memcpy(reserve(replies, length), text, length);
+    commit_with_id(replies, length, peek_record(text).id);
+}
+
+/**
+ * @brief Receiver: end the reply stream once the requests have, then wait for the sender to drain it
+ */
+void rpc_server_close(mailbox_t *replies)
+{
+    finish(replies);
+    printf("Replied to %llu requests\n", (unsigned long long)replies->messages);
+    replies->transport->close(replies, ROLE_SENDER);
+}
@@ -0,0 +1,47 @@
+#ifndef RPC_H
+#define RPC_H
+
+#include <pthread.h>
+
+#include "batch.h"
+
+#define RPC_CHANNEL "reply"       // channel the replies come back on
+#define RPC_READY "/rpc_ready"    // posted by the receiver once its reply ring is set up
+#define RPC_WINDOW 64             // requests the sender may have outstanding by default
+
+/*
+ * Request/response over two channels: requests go out on the sender's transport as usual,
+ * the receiver answers each one on a shared memory ring carrying the id of the request,
+ * so the sender can match replies while up to window requests are outstanding.
+ */
+typedef struct {
+    atomic_ulong id;              // request id, UINT64_MAX once answered and the slot free again
+    uint64_t stamp;               // when the request was committed
+    unsigned short length;        // request payload, the reply echoes it
+} rpc_call_t;
+
+typedef struct rpc {
+    mailbox_t replies;            // the reverse channel, drained by the reply thread
+    unsigned int window;          // requests that may be outstanding
+    rpc_call_t *calls;            // outstanding requests, indexed by id % window
+    uint64_t sent;                // requests committed
+    atomic_ulong answered;        // replies received
+    waitpoint_t space;            // the sender sleeps here while the window is full
+    uint64_t full;                // times the window was full
+    uint64_t unmatched;           // replies that matched no outstanding request
+    histogram_t round_trip;       // request commit to reply peek
+    sem_t *ready;
+    pthread_t thread;
+} rpc_t;
+
+int rpc_client_open(rpc_t *rpc, unsigned int window);
+int rpc_client_start(rpc_t *rpc, mailbox_t *requests);
+void rpc_wait_window(mailbox_t *requests);
+void rpc_track(rpc_t *rpc, const record_t *record);
+void rpc_client_close(rpc_t *rpc);
+
+int rpc_server_open(mailbox_t *replies, const mailbox_t *requests);
+void rpc_reply(mailbox_t *replies, const char *text, unsigned short length);
+void rpc_server_close(mailbox_t *replies);
+
+#endif
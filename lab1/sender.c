@@ -1,152 +1,577 @@
 #include "sender.h"
 
-double time_taken = 0.0;
+_Thread_local double time_taken = 0.0;
 
-
-void send(message_t message, mailbox_t* mailbox_ptr){
+void send(const message_t* message_ptr, mailbox_t* mailbox_ptr){
     /*  TODO: 
         1. Use flag to determine the communication method
         2. According to the communication method, send the message
     */
-    struct timespec start, end;
-    sem_wait(mailbox_ptr->sem_receive);
-
-    if (mailbox_ptr->flag == 1) {
-        // Message passing using POSIX message queue
-        clock_gettime(CLOCK_MONOTONIC, &start);  // Start time
-        if (mq_send(mailbox_ptr->storage.mqd, message.msg_text, MAX_MESSAGE_SIZE, 0) == -1) {
-            perror("mq_send");
-        }
-        clock_gettime(CLOCK_MONOTONIC, &end);    // End time
-    } else if (mailbox_ptr->flag == 2) {
-        clock_gettime(CLOCK_MONOTONIC, &start);  // Start time
-        //strncpy(mailbox_ptr->storage.shm_addr, message.msg_text, MAX_MESSAGE_SIZE - 1);
-        strcpy(mailbox_ptr->storage.shm_addr, message.msg_text);
-        mailbox_ptr->storage.shm_addr[MAX_MESSAGE_SIZE - 1] = '\0';  // Ensure null-termination
-        clock_gettime(CLOCK_MONOTONIC, &end);    // End time
+    // End of stream goes out as its own control frame right behind the pending records
+    if (message_ptr->type == MSG_EXIT) {
+        finish(mailbox_ptr);
+        return;
     }
 
+    set_priority(mailbox_ptr, message_ptr->priority);
+    memcpy(reserve(mailbox_ptr, message_ptr->length), message_ptr->msg_text, message_ptr->length);
+    commit(mailbox_ptr, message_ptr->length);
+
+    //printf("Message sent in %f seconds\n", time_taken);
+}
 
-    time_taken += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
-    sem_post(mailbox_ptr->sem_send);
+static unsigned int line_priority(const char* text, size_t length){
+    /*
+        With -p a line marked urgent by leading '!'s goes at one priority level per '!'
+    */
+    unsigned int priority = 0;
 
+    while (priority < length && priority < PRIORITY_LEVELS - 1 && text[priority] == '!')
+        priority++;
+    return priority;
+}
 
-    //printf("Message sent in %f seconds\n", time_taken);
+/*
+ * Newline search for the mmap input mode, 16/32 bytes per step where the CPU allows.
+ * Each returns the first '\n' in [p, end), or end if there is none.
+ */
+static const char* scan_newline_scalar(const char* p, const char* end){
+    const char *nl = memchr(p, '\n', end - p);
+    return nl ? nl : end;
+}
+
+#if defined(__SSE2__)
+static const char* scan_newline_sse2(const char* p, const char* end){
+    const __m128i newline = _mm_set1_epi8('\n');
+
+    for (; end - p >= 16; p += 16) {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), newline));
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+    return scan_newline_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* scan_newline_avx2(const char* p, const char* end){
+    const __m256i newline = _mm256_set1_epi8('\n');
+
+    for (; end - p >= 32; p += 32) {
+        unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), newline));
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+    return scan_newline_sse2(p, end);
+}
+#endif
+
+#if defined(__ARM_NEON)
+static const char* scan_newline_neon(const char* p, const char* end){
+    const uint8x16_t newline = vdupq_n_u8('\n');
+
+    for (; end - p >= 16; p += 16) {
+        // Narrow the 16 compare bytes to 4 bits each so the whole result fits in one 64-bit lane
+        uint8x16_t eq = vceqq_u8(vld1q_u8((const uint8_t *)p), newline);
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        if (mask)
+            return p + (__builtin_ctzll(mask) >> 2);
+    }
+    return scan_newline_scalar(p, end);
+}
+#endif
+
+static const char* (*scan_newline)(const char* p, const char* end) = scan_newline_scalar;
+
+static void select_scan_newline(void){
+#if defined(__SSE2__)
+    __builtin_cpu_init();
+    scan_newline = __builtin_cpu_supports("avx2") ? scan_newline_avx2 : scan_newline_sse2;
+#elif defined(__ARM_NEON)
+    scan_newline = scan_newline_neon;
+#endif
+}
+
+static int map_input_file(const char* input_file, const char** data_ptr, size_t* size_ptr){
+    /*
+        Map input_file read-only for a sequential scan, *data_ptr is NULL for an empty file
+    */
+    int fd = open(input_file, O_RDONLY);
+    struct stat st;
+
+    *data_ptr = NULL;
+    *size_ptr = 0;
+    if (fd == -1) {
+        perror("open");
+        return -1;
+    }
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    *data_ptr = data;
+    *size_ptr = st.st_size;
+    return 0;
+}
+
+static const char* next_line(const char* p, const char* end, unsigned short* length_ptr){
+    /*
+        Line starting at p, cut where fgets would cut it; return where the next one starts
+    */
+    const char *limit = end - p > MAX_MESSAGE_SIZE - 1 ? p + MAX_MESSAGE_SIZE - 1 : end;
+    const char *nl = scan_newline(p, limit);
+
+    *length_ptr = nl - p;
+    return nl < limit ? nl + 1 : nl;
+}
+
+static int send_mapped_file(mailbox_t* mailbox_ptr, const char* input_file, int prioritize){
+    /*
+        Send every line of input_file straight out of a read-only mapping, no stdio in between.
+        Lines longer than a message are split the way fgets would split them.
+    */
+    const char *data;
+    size_t size;
+
+    if (map_input_file(input_file, &data, &size) == -1)
+        return -1;
+    if (data == NULL)
+        return 0;
+
+    const char *p = data;
+    const char *end = data + size;
+    while (p < end) {
+        unsigned short length;
+        const char *next = next_line(p, end, &length);
+
+        printf("Sending message: %.*s\n", length, p);
+        if (prioritize)
+            set_priority(mailbox_ptr, line_priority(p, length));
+        memcpy(reserve(mailbox_ptr, length), p, length);
+        commit(mailbox_ptr, length);
+        p = next;
+    }
+
+    munmap((void *)data, size);
+    return 0;
+}
+
+/*
+ * With -T the mapped input is split into one newline-aligned region per reader thread.
+ * Each reader batches the lines of its region in a mailbox of its own, every message numbered
+ * with its place in the file, and hands each full frame over to the shared mailbox under a lock.
+ */
+typedef struct {
+    mailbox_t mailbox;            // first, so the submit op finds its reader from the mailbox
+    mailbox_t *shared;            // the one opened on the transport
+    pthread_mutex_t *lock;        // one reader at a time on the shared mailbox
+    pthread_barrier_t *counted;   // every region's message count is known
+    uint64_t *counts;             // messages per region
+    unsigned int index;
+    const char *begin;
+    const char *end;
+    int prioritize;
+    double time_taken;            // the reader's share of the sending time
+} reader_t;
+
+static int reader_submit(mailbox_t* mailbox_ptr, frame_t* frame){
+    /*
+        Copy a reader's frame into the shared mailbox's transport and send it there
+    */
+    reader_t *reader = (reader_t *)mailbox_ptr;
+    mailbox_t *shared = reader->shared;
+
+    pthread_mutex_lock(reader->lock);
+    if (shared->messages == 0)
+        shared->first_ns = mailbox_ptr->first_ns;
+    shared->batch.priority = frame->priority;
+    frame_t *slot = shared->transport->claim(shared);
+    memcpy(slot, frame, FRAME_HEADER_SIZE + frame->length);
+    shared->messages += frame->count;
+    shared->bytes += frame->length - frame->count * RECORD_HEADER_SIZE;
+    shared->transport->send(shared, slot);
+    pthread_mutex_unlock(reader->lock);
+    return 0;
+}
+
+static const transport_t reader_transport = {
+    .name = "reader",
+    .label = "Reader thread",
+    .claim = transport_staging_frame,
+    .send = reader_submit,
+};
+
+static void* reader_thread(void* arg){
+    /*
+        Count the messages of the region, then send them numbered after those of the regions before it
+    */
+    reader_t *reader = arg;
+    mailbox_t *mailbox_ptr = &reader->mailbox;
+    unsigned short length;
+    const char *p;
+    uint64_t id = 0;
+
+    for (p = reader->begin; p < reader->end; p = next_line(p, reader->end, &length))
+        reader->counts[reader->index]++;
+    pthread_barrier_wait(reader->counted);
+    for (unsigned int i = 0; i < reader->index; ++i)
+        id += reader->counts[i];
+
+    for (p = reader->begin; p < reader->end; ) {
+        const char *next = next_line(p, reader->end, &length);
+
+        printf("Sending message: %.*s\n", length, p);
+        if (reader->prioritize)
+            set_priority(mailbox_ptr, line_priority(p, length));
+        memcpy(reserve(mailbox_ptr, length), p, length);
+        commit_with_id(mailbox_ptr, length, id++);
+        p = next;
+    }
+    flush(mailbox_ptr);
+    reader->time_taken = time_taken;
+    return NULL;
+}
+
+static int send_parallel_file(mailbox_t* mailbox_ptr, const char* input_file, unsigned int threads, int prioritize){
+    /*
+        Send input_file from threads readers, each with a region of whole lines.
+        The receiver gets them in no particular order, the ids tell the original one (see ./receiver -O).
+    */
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_barrier_t counted;
+    const char *data;
+    size_t size;
+
+    if (map_input_file(input_file, &data, &size) == -1)
+        return -1;
+    if (data == NULL)
+        return 0;
+
+    reader_t *readers = calloc(threads, sizeof(reader_t));
+    uint64_t *counts = calloc(threads, sizeof(uint64_t));
+    if (readers == NULL || counts == NULL) {
+        perror("calloc");
+        free(readers);
+        free(counts);
+        munmap((void *)data, size);
+        return -1;
+    }
+    pthread_barrier_init(&counted, NULL, threads);
+
+    const char *begin = data;
+    const char *end = data + size;
+    for (unsigned int i = 0; i < threads; ++i) {
+        reader_t *reader = &readers[i];
+        // Every region but the last ends at the first line start past its share of the file
+        const char *stop = end;
+        if (i + 1 < threads) {
+            const char *cut = data + size * (i + 1) / threads;
+            stop = begin;
+            if (cut > begin) {
+                stop = scan_newline(cut - 1, end);
+                stop = stop < end ? stop + 1 : end;
+            }
+        }
+
+        reader->mailbox.transport = &reader_transport;
+        reader->mailbox.batch.max_count = mailbox_ptr->batch.max_count;
+        reader->mailbox.batch.max_bytes = mailbox_ptr->batch.max_bytes;
+        reader->mailbox.batch.max_delay_ns = mailbox_ptr->batch.max_delay_ns;
+        reader->shared = mailbox_ptr;
+        reader->lock = &lock;
+        reader->counted = &counted;
+        reader->counts = counts;
+        reader->index = i;
+        reader->begin = begin;
+        reader->end = stop;
+        reader->prioritize = prioritize;
+        begin = stop;
+    }
+
+    pthread_t tids[threads];
+    for (unsigned int i = 0; i < threads; ++i) {
+        int error = pthread_create(&tids[i], NULL, reader_thread, &readers[i]);
+        if (error != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(error));
+            return -1;
+        }
+    }
+    for (unsigned int i = 0; i < threads; ++i) {
+        pthread_join(tids[i], NULL);
+        time_taken += readers[i].time_taken;
+    }
+
+    pthread_barrier_destroy(&counted);
+    free(readers);
+    free(counts);
+    munmap((void *)data, size);
+    return 0;
 }
 
 int main(int argc, char *argv[]){
     /*  TODO: 
-        1) Call send(message, &mailbox) according to the flow in slide 4
+        1) Call send(&message, &mailbox) (or reserve/commit) according to the flow in slide 4
         2) Measure the total sending time
         3) Get the mechanism and the input file from command line arguments
             • e.g. ./sender 1 input.txt
-                    (1 for Message Passing, 2 for Shared Memory)
+                    (1 for Message Passing, 2 for Shared Memory, 3 for Shared Memory Ring, 4 for Shared Memory MPMC,
+                     5 for Shared Memory Stream, 6 to 15 for pipe, fifo, seqpacket, eventfd, splice, lanes, seqlock, arena, broadcast and auto, or the name, see transport.c)
         4) Get the messages to be sent from the input file
         5) Print information on the console according to the output format
         6) If the message form the input file is EOF, send an exit message to the receiver.c
         7) Print the total sending time and terminate the sender.c
     */
     
-    if (argc != 3) {
-        printf("Usage: ./sender <mechanism> <input_file>\n");
+    // Batching defaults: one message per frame, as without batching
+    unsigned int batch_count = 1;
+    unsigned int batch_bytes = FRAME_SIZE;
+    long batch_usec = 0;
+    // Ring wait defaults: spin briefly, then sleep on the futex
+    int wait_strategy = WAIT_FUTEX;
+    unsigned int spin_budget = DEFAULT_SPIN_BUDGET;
+    // Message queue credits: one frame in flight unless -d pipelines up to the queue depth
+    unsigned int queue_depth = 10;
+    unsigned int credits = 1;
+    // Senders sharing the MPMC queue of mechanism 4
+    unsigned int producers = 1;
+    // Receivers of mechanism 14, the sender waits for all of them
+    unsigned int subscribers = 1;
+    // Read the input through stdio unless -m asks for a mapping
+    int mmap_input = 0;
+    // Segment on hugetlbfs mounted at -H, CPU to stay on with -C
+    char *huge_dir = NULL;
+    int cpu = -1;
+    // Requests that may await their reply with -R, 0 for one-way messages
+    unsigned int rpc_window = 0;
+    // Send lines starting with '!' ahead of the others with -p
+    int prioritize = 0;
+    // Channel name for a receiver serving several senders with -N, none by default
+    char *channel = NULL;
+    // Reader threads splitting the input with -T, the input is read by this one otherwise
+    unsigned int threads = 0;
+    // Hold the first message back until the receiver is open with -g, so its start-up is not timed
+    int wait_ready = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:s:t:w:n:md:P:S:H:C:R:pN:T:g")) != -1) {
+        switch (opt) {
+        case 'g':
+            wait_ready = 1;
+            break;
+        case 'T':
+            threads = atoi(optarg);
+            if (threads == 0)
+                argc = -1;
+            break;
+        case 'N':
+            channel = optarg;
+            break;
+        case 'p':
+            prioritize = 1;
+            break;
+        case 'R':
+            rpc_window = atoi(optarg);
+            if (rpc_window == 0)
+                argc = -1;
+            break;
+        case 'H':
+            huge_dir = optarg;
+            break;
+        case 'C':
+            cpu = atoi(optarg);
+            break;
+        case 'c':
+            batch_count = atoi(optarg);
+            break;
+        case 's':
+            batch_bytes = atoi(optarg);
+            break;
+        case 't':
+            batch_usec = atol(optarg);
+            break;
+        case 'w':
+            wait_strategy = parse_wait_strategy(optarg);
+            break;
+        case 'n':
+            spin_budget = atoi(optarg);
+            break;
+        case 'm':
+            mmap_input = 1;
+            break;
+        case 'd':
+            queue_depth = credits = atoi(optarg);
+            break;
+        case 'P':
+            producers = atoi(optarg);
+            break;
+        case 'S':
+            subscribers = atoi(optarg);
+            break;
+        default:
+            argc = -1;
+        }
+    }
+
+    const transport_t *transport = argc - optind == 2 ? transport_find(argv[optind]) : NULL;
+
+    if (transport == NULL || batch_count == 0 || wait_strategy < 0 || credits == 0 || producers == 0) {
+        printf("Usage: ./sender [-c batch_count] [-s batch_bytes] [-t batch_usec] [-w poll|futex|sem|eventfd] [-n spin_budget] [-m] [-d queue_depth] [-P producers] [-S subscribers] [-H hugetlbfs_dir] [-C cpu] [-R window] [-p] [-N channel] [-T threads] [-g] <mechanism> <input_file>\n");
+        transport_usage(stdout);
+        return -1;
+    }
+    // Replies are matched to requests, which the byte streams do not have and the seqlock may overwrite, and one sender reads them from one receiver
+    if (rpc_window > 0 && (transport->claim == NULL || transport == &transport_seqlock || producers > 1 || subscribers > 1 || channel != NULL)) {
+        fprintf(stderr, "-R needs a frame transport and a single sender, not on a channel\n");
+        return -1;
+    }
+    // Readers hand over whole frames, which the byte streams do not take, and RPC tracks one thread's requests
+    if (threads > 0 && (transport->claim == NULL || rpc_window > 0)) {
+        fprintf(stderr, "-T needs a frame transport and no -R\n");
         return -1;
     }
 
-    int mechanism = atoi(argv[1]);
-    char *input_file = argv[2];
+    // Every sender of the queue would wait for the same post, only one of them gets it
+    if (wait_ready && producers > 1) {
+        fprintf(stderr, "-g needs a single sender\n");
+        return -1;
+    }
 
-    // Initialize mailbox
-    mailbox_t mailbox;
-    mailbox.flag = mechanism;
+    char *input_file = argv[optind + 1];
 
-    if (mechanism == 1) {
-        // POSIX message queue setup
-        struct mq_attr attr = {0, 10, MAX_MESSAGE_SIZE*sizeof(char), 0};
-        
-        mailbox.storage.mqd = mq_open("/msg_queue", O_CREAT | O_WRONLY, 0666, &attr);
-        mailbox.sem_send = sem_open("/sender", O_CREAT, 0666, 0);
-        mailbox.sem_receive = sem_open("/receiver", O_CREAT, 0666, 0);
-        if (mailbox.storage.mqd == (mqd_t)-1) {
-            perror("mq_open");
-            return -1;
-        }
-        if (mailbox.sem_send == SEM_FAILED || mailbox.sem_receive == SEM_FAILED) {
-            perror("sem_open");
+    // Initialize mailbox, static so the batch starts out empty
+    static mailbox_t mailbox;
+    mailbox.flag = transport->id;
+    mailbox.transport = transport;
+    mailbox.batch.max_count = batch_count;
+    mailbox.batch.max_bytes = batch_bytes;
+    mailbox.batch.max_delay_ns = batch_usec * 1000;
+    mailbox.wait_strategy = wait_strategy;
+    mailbox.spin_budget = spin_budget;
+    mailbox.queue_depth = queue_depth;
+    mailbox.credits = credits;
+    mailbox.producers = producers;
+    mailbox.subscribers = subscribers;
+    mailbox.huge_dir = huge_dir;
+    mailbox.channel = channel;
+
+    static rpc_t rpc;
+    sem_t *ready = NULL;
+
+    if (cpu >= 0 && pin_to_cpu(cpu) == -1)
+        return -1;
+    if (rpc_window > 0 && rpc_client_open(&rpc, rpc_window) == -1)
+        return -1;
+    if (wait_ready && (ready = transport_open_ready(&mailbox)) == SEM_FAILED)
+        return -1;
+    // Before the transport, whose open may wait for the receiver, so the receiver finds the page
+    if (transport_open_stats(&mailbox, ROLE_SENDER) == -1)
+        return -1;
+
+    if (mailbox.transport->open(&mailbox, ROLE_SENDER) == -1)
+        return -1;
+    if (rpc_window > 0 && rpc_client_start(&rpc, &mailbox) == -1)
+        return -1;
+    if (wait_ready)
+        transport_wait_ready(&mailbox, ready);
+    printf("%s\n", mailbox.transport->label);
+    if (mailbox.segment_huge)
+        printf("Segment on huge pages in %s\n", huge_dir);
+    if (cpu >= 0)
+        printf("Pinned to CPU %d\n", cpu);
+    if (rpc_window > 0)
+        printf("RPC, up to %u requests outstanding\n", rpc_window);
+    if (channel != NULL)
+        printf("On channel %s\n", channel);
+
+    message_t message;
+    int input_lost = 0;
+    if (mailbox.transport->send_file) {
+        printf("Streaming %s\n", input_file);
+        // The stream is still ended on failure, so clean up as usual and exit non-zero at the end
+        if (mailbox.transport->send_file(&mailbox, input_file) == -1)
+            input_lost = 1;
+    } else if (threads > 0) {
+        printf("Reading with %u threads\n", threads);
+        select_scan_newline();
+        if (send_parallel_file(&mailbox, input_file, threads, prioritize) == -1)
             return -1;
-        }
-        printf("Message Passing\n");
-    } else if (mechanism == 2) {
-        // POSIX shared memory setup
-        int shm_fd = shm_open("/shm_memory", O_CREAT | O_RDWR, 0666);
-        mailbox.sem_send = sem_open("/sender", O_CREAT, 0666, 0);
-        mailbox.sem_receive = sem_open("/receiver", O_CREAT, 0666, 0);
-        if (shm_fd == -1) {
-            perror("shm_open");
+    } else if (mmap_input) {
+        select_scan_newline();
+        if (send_mapped_file(&mailbox, input_file, prioritize) == -1)
             return -1;
-        }
-        if (mailbox.sem_send == SEM_FAILED || mailbox.sem_receive == SEM_FAILED) {
-            perror("sem_open");
+    } else if (prioritize) {
+        // The priority is only known once the line is read, so read it aside and send() it
+        FILE *file = fopen(input_file, "r");
+        if (!file) {
+            perror("fopen");
             return -1;
         }
-        
-        if(ftruncate(shm_fd, MAX_MESSAGE_SIZE) == -1){
-          perror("shm_ftruncate");
-          return -1;
+
+        message.type = MSG_DATA;
+        while (fgets(message.msg_text, MAX_MESSAGE_SIZE, file)) {
+            message.length = strcspn(message.msg_text, "\n");
+            message.msg_text[message.length] = '\0';  // Remove newline character
+            message.priority = line_priority(message.msg_text, message.length);
+            printf("Sending message: %s\n", message.msg_text);
+            send(&message, &mailbox);
         }
-        
-        mailbox.storage.shm_addr = mmap(NULL, MAX_MESSAGE_SIZE, PROT_WRITE, MAP_SHARED, shm_fd, 0);
-        if (mailbox.storage.shm_addr == MAP_FAILED) {
-            perror("mmap");
+        fclose(file);
+    } else {
+        // Open the input file
+        FILE *file = fopen(input_file, "r");
+        if (!file) {
+            perror("fopen");
             return -1;
         }
-        printf("Share Memory\n");
-    }
 
-    // Open the input file
-    FILE *file = fopen(input_file, "r");
-    if (!file) {
-        perror("fopen");
-        return -1;
-    }
+        // Read messages from the input file straight into the reserved space and send
+        char *text = reserve(&mailbox, MAX_MESSAGE_SIZE);
+        unsigned short length;
 
-    // Read messages from the input file and send
-    char line[MAX_MESSAGE_SIZE];
-    message_t message;
-
-    while (fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\n")] = '\0';  // Remove newline character
-        strncpy(message.msg_text, line, MAX_MESSAGE_SIZE);
-        printf("Sending message: %s\n", message.msg_text);
-        send(message, &mailbox);
+        while (fgets(text, MAX_MESSAGE_SIZE, file)) {
+            length = strcspn(text, "\n");
+            text[length] = '\0';  // Remove newline character
+            printf("Sending message: %s\n", text);
+            commit(&mailbox, length);
+            text = reserve(&mailbox, MAX_MESSAGE_SIZE);
+        }
+        fclose(file);
     }
 
     // Send exit message
-    strncpy(message.msg_text, "exit", MAX_MESSAGE_SIZE);
+    message.type = MSG_EXIT;
+    message.length = 0;
     printf("End of input file! exit!\n");
-    send(message, &mailbox);
+    if (!mailbox.transport->send_file)
+        send(&message, &mailbox);
     printf("Total time taken in sending msg: %.6fs\n", time_taken);
+    print_throughput("Sender", mailbox.messages, mailbox.bytes, now_ns() - mailbox.first_ns);
+    if (rpc_window > 0)
+        rpc_client_close(&rpc);
+
+    if (mailbox.transport->stats)
+        mailbox.transport->stats(&mailbox, ROLE_SENDER);
 
     // Cleanup
-    fclose(file);
-    if (mechanism == 1) {
-        mq_close(mailbox.storage.mqd);
-        mq_unlink("/msg_queue");
-        sem_close(mailbox.sem_send);
-        sem_close(mailbox.sem_receive);
-        sem_unlink("/sender");
-        sem_unlink("/receiver");
-    } else if (mechanism == 2) {
-        munmap(mailbox.storage.shm_addr, MAX_MESSAGE_SIZE);
-        shm_unlink("/shm_memory");
-        sem_close(mailbox.sem_send);
-        sem_close(mailbox.sem_receive);
-        sem_unlink("/sender");
-        sem_unlink("/receiver");
-    } else {
-        perror("argv[1]");
+    mailbox.transport->close(&mailbox, ROLE_SENDER);
+    transport_close_stats(&mailbox);
+
+    if (input_lost) {
+        fprintf(stderr, "Some of the input was not sent\n");
         return -1;
     }
-    
     return 0;
 
 }
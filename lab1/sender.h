@@ -13,28 +13,16 @@
 #include <time.h>
 #include <mqueue.h>
 #include <sys/mman.h>
+#include <sched.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
-#define MAX_MESSAGE_SIZE 1025
+#include "transport.h"
+#include "batch.h"
+#include "rpc.h"
 
-
-typedef struct {
-    int flag;      // 1 for message passing, 2 for shared memory
-    union{
-        //int msqid; //for system V api. You can replace it with struecture for POSIX api
-        mqd_t mqd;
-        char* shm_addr;
-    }storage;
-    sem_t* sem_send;
-    sem_t* sem_receive;
-} mailbox_t;
-
-
-typedef struct {
-    /*  TODO: 
-        Message structure for wrapper
-    */
-    char msg_text[MAX_MESSAGE_SIZE];
-    
-} message_t;
-
-void send(message_t message, mailbox_t* mailbox_ptr);
+void send(const message_t* message_ptr, mailbox_t* mailbox_ptr);
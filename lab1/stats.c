@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "stats.h"
+
+/**
+ * @brief Upper bound of the values counted in bucket index
+ */
+static uint64_t histogram_value(unsigned int index)
+{
+    if (index < HIST_SUB_COUNT)
+        return index;
+    unsigned int shift = (index >> HIST_SUB_BITS) - 1;
+    return ((uint64_t)(HIST_SUB_COUNT + (index & (HIST_SUB_COUNT - 1))) << shift) + ((1ull << shift) - 1);
+}
+
+/**
+ * @brief Smallest recorded value that at least percentile % of the samples do not exceed
+ * 
+ * @param hist Histogram to query
+ * @param percentile 0 to 100
+ * @return uint64_t 
+ * Return the value, capped at the recorded maximum, 0 if nothing was recorded
+ */
+uint64_t histogram_percentile(const histogram_t *hist, double percentile)
+{
+    uint64_t rank = (uint64_t)(hist->total * percentile / 100.0 + 0.5);
+    uint64_t seen = 0;
+
+    if (rank == 0)
+        rank = 1;
+    for (unsigned int i = 0; i < HIST_BUCKETS; ++i) {
+        seen += hist->counts[i];
+        if (seen >= rank) {
+            uint64_t value = histogram_value(i);
+            return value < hist->max ? value : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+/**
+ * @brief Print p50/p90/p99/p99.9/max of a histogram of nanoseconds, in microseconds
+ */
+void print_latency(const char *label, const histogram_t *hist)
+{
+    if (hist->total == 0)
+        return;
+    printf("%s latency (us): p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f\n", label,
+           histogram_percentile(hist, 50.0) / 1e3, histogram_percentile(hist, 90.0) / 1e3,
+           histogram_percentile(hist, 99.0) / 1e3, histogram_percentile(hist, 99.9) / 1e3,
+           hist->max / 1e3);
+}
+
+/**
+ * @brief Print message and byte rates over elapsed_ns
+ */
+void print_throughput(const char *label, uint64_t messages, uint64_t bytes, uint64_t elapsed_ns)
+{
+    double seconds = elapsed_ns / 1e9;
+
+    if (seconds <= 0.0)
+        return;
+    printf("%s throughput: %llu msgs, %llu bytes in %.6fs, %.0f msgs/s, %.2f MB/s\n", label,
+           (unsigned long long)messages, (unsigned long long)bytes, seconds,
+           messages / seconds, bytes / seconds / 1e6);
+}
+
+/**
+ * @brief Map the stats page name, creating it when oflag has O_CREAT
+ *
+ * @param oflag O_RDONLY for a monitor, which maps it read-only, O_RDWR with or without O_CREAT for the ends
+ * @return stats_page_t*
+ * Return the mapping, NULL on error
+ */
+stats_page_t* stats_page_map(const char *name, int oflag)
+{
+    int prot = (oflag & O_ACCMODE) == O_RDONLY ? PROT_READ : PROT_READ | PROT_WRITE;
+    int fd = shm_open(name, oflag, 0666);
+    void *page;
+
+    if (fd == -1) {
+        perror("shm_open stats page");
+        return NULL;
+    }
+    if ((oflag & O_CREAT) && ftruncate(fd, sizeof(stats_page_t)) == -1) {
+        perror("ftruncate");
+        close(fd);
+        return NULL;
+    }
+    page = mmap(NULL, sizeof(stats_page_t), prot, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+    return page;
+}
+
+/**
+ * @brief Add what changed in totals since the last call to side, no read-modify-write when nothing did
+ *
+ * @param published What this end has added to side so far, brought up to totals
+ */
+void stats_page_publish(stats_side_t *side, stats_totals_t *published, const stats_totals_t *totals, uint64_t max_latency_ns)
+{
+    if (totals->messages != published->messages)
+        atomic_fetch_add_explicit(&side->messages, totals->messages - published->messages, memory_order_relaxed);
+    if (totals->bytes != published->bytes)
+        atomic_fetch_add_explicit(&side->bytes, totals->bytes - published->bytes, memory_order_relaxed);
+    if (totals->frames != published->frames)
+        atomic_fetch_add_explicit(&side->frames, totals->frames - published->frames, memory_order_relaxed);
+    if (totals->blocked != published->blocked)
+        atomic_fetch_add_explicit(&side->blocked, totals->blocked - published->blocked, memory_order_relaxed);
+    *published = *totals;
+
+    uint64_t max = atomic_load_explicit(&side->max_latency_ns, memory_order_relaxed);
+    while (max_latency_ns > max &&
+           !atomic_compare_exchange_weak_explicit(&side->max_latency_ns, &max, max_latency_ns,
+                                                  memory_order_relaxed, memory_order_relaxed))
+        ;
+}
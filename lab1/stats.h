@@ -0,0 +1,89 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define CACHE_LINE_SIZE 64
+
+/*
+ * Log-bucketed latency histogram in the style of HdrHistogram.
+ * Values below HIST_SUB_COUNT are exact, above that every power of two is split
+ * into HIST_SUB_COUNT linear buckets, so any value is off by at most 1/HIST_SUB_COUNT.
+ */
+#define HIST_SUB_BITS 4
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+} histogram_t;
+
+// CLOCK_MONOTONIC through the vDSO, no system call, comparable across processes
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline unsigned int histogram_index(uint64_t value)
+{
+    if (value < HIST_SUB_COUNT)
+        return value;
+    unsigned int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+    return ((shift + 1) << HIST_SUB_BITS) + ((value >> shift) & (HIST_SUB_COUNT - 1));
+}
+
+static inline void histogram_record(histogram_t *hist, uint64_t value)
+{
+    hist->counts[histogram_index(value)]++;
+    hist->total++;
+    if (value > hist->max)
+        hist->max = value;
+}
+
+/*
+ * Live counters of a running channel in a small shared memory page, for ./monitor.
+ * Every end adds what it moved since it last published with relaxed atomics, so several
+ * senders or receivers may share one side, and readers may see the totals up to a frame late.
+ * Messages and frames in flight are the sender's totals minus the receiver's.
+ */
+#define STATS_PAGE "/lab1_stats"      // channels append their name, like every other IPC name
+#define STATS_MAGIC 0x53544154u
+
+typedef struct {
+    uint64_t messages;
+    uint64_t bytes;
+    uint64_t frames;
+    uint64_t blocked;
+} stats_totals_t;
+
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong messages;
+    atomic_ulong bytes;
+    atomic_ulong frames;
+    atomic_ulong blocked;          // times an end waited for the other, the sender on a full queue
+    atomic_ulong max_latency_ns;   // receiver: longest commit to peek time seen
+    atomic_uint attached;          // ends of this side that opened the page
+    atomic_uint closed;            // and have closed it since
+} stats_side_t;
+
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_uint magic;   // STATS_MAGIC once a sender has set the page up
+    char transport[16];                             // name of the mechanism
+    stats_side_t sender;
+    stats_side_t receiver;
+} stats_page_t;
+
+uint64_t histogram_percentile(const histogram_t *hist, double percentile);
+void print_latency(const char *label, const histogram_t *hist);
+void print_throughput(const char *label, uint64_t messages, uint64_t bytes, uint64_t elapsed_ns);
+
+stats_page_t* stats_page_map(const char *name, int oflag);
+void stats_page_publish(stats_side_t *side, stats_totals_t *published, const stats_totals_t *totals, uint64_t max_latency_ns);
+
+#endif
@@ -0,0 +1,610 @@
+#define _GNU_SOURCE    // accept4, MSG_CMSG_CLOEXEC and sched_setaffinity
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sched.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "transport.h"
+
+// Indexed by id - 1, so mechanism numbers stay what they were before the names
+static const transport_t *const transports[] = {
+    &transport_mq,
+    &transport_shm,
+    &transport_ring,
+    &transport_mpmc,
+    &transport_stream,
+    &transport_pipe,
+    &transport_fifo,
+    &transport_seqpacket,
+    &transport_eventfd,
+    &transport_splice,
+    &transport_lanes,
+    &transport_seqlock,
+    &transport_arena,
+    &transport_broadcast,
+    &transport_auto,
+};
+
+#define TRANSPORT_COUNT (sizeof(transports) / sizeof(transports[0]))
+
+/**
+ * @brief Look a transport up by its number or its name
+ *
+ * @param mechanism e.g. "1" or "mq"
+ * @return const transport_t*
+ * Return NULL if there is no such transport
+ */
+const transport_t* transport_find(const char *mechanism)
+{
+    char *end;
+    long id = strtol(mechanism, &end, 10);
+
+    if (*mechanism != '\0' && *end == '\0')
+        return id >= 1 && id <= (long)TRANSPORT_COUNT ? transports[id - 1] : NULL;
+    for (unsigned int i = 0; i < TRANSPORT_COUNT; ++i)
+        if (strcmp(transports[i]->name, mechanism) == 0)
+            return transports[i];
+    return NULL;
+}
+
+/**
+ * @brief Print the mechanisms a usage line may name
+ */
+void transport_usage(FILE *stream)
+{
+    fprintf(stream, "Mechanisms:");
+    for (unsigned int i = 0; i < TRANSPORT_COUNT; ++i)
+        fprintf(stream, " %d|%s", transports[i]->id, transports[i]->name);
+    fprintf(stream, "\n");
+}
+
+/**
+ * @brief claim for the transports that copy the frame out in send: the mailbox's own staging frame
+ */
+frame_t* transport_staging_frame(mailbox_t *mailbox_ptr)
+{
+    return &mailbox_ptr->batch.frame;
+}
+
+/**
+ * @brief sem_wait() on sem, counted as a sleep when the semaphore is not free right away
+ */
+void transport_sem_wait(mailbox_t *mailbox_ptr, sem_t *sem)
+{
+    if (sem_trywait(sem) == 0)
+        return;
+    mailbox_ptr->sleeps++;
+    sem_wait(sem);
+}
+
+/**
+ * @brief Count a sleep if the blocking read or write on fd about to be made would have to wait for the other end
+ *
+ * @param events POLLIN before a read, POLLOUT before a write
+ */
+void transport_poll(mailbox_t *mailbox_ptr, int fd, short events)
+{
+    struct pollfd pfd = {fd, events, 0};
+
+    if (poll(&pfd, 1, 0) == 0)
+        mailbox_ptr->sleeps++;
+}
+
+/**
+ * @brief Count a frame of frame_size bytes as moved and add the time since start to time_taken
+ */
+void transport_account(mailbox_t *mailbox_ptr, const struct timespec *start, size_t frame_size)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    time_taken += (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) * 1e-9;
+    mailbox_ptr->frames++;
+    mailbox_ptr->wire_bytes += frame_size;
+    stats_publish(mailbox_ptr);
+}
+
+/**
+ * @brief Default stats: frames moved, records per frame and how often this end blocked
+ */
+void transport_stats(const mailbox_t *mailbox_ptr, int role)
+{
+    if (mailbox_ptr->frames == 0)
+        return;
+    printf("%s transport %s: %llu frames, %llu bytes on the wire, %.1f msgs/frame, %llu sleeps\n",
+           role == ROLE_SENDER ? "Sender" : "Receiver", mailbox_ptr->transport->name,
+           (unsigned long long)mailbox_ptr->frames, (unsigned long long)mailbox_ptr->wire_bytes,
+           (double)mailbox_ptr->messages / mailbox_ptr->frames, (unsigned long long)mailbox_ptr->sleeps);
+}
+
+/**
+ * @brief Name of the IPC object base for the mailbox's channel: base itself by default, base_channel otherwise
+ *
+ * @param name Where a channel's name is built, returned instead of base
+ */
+const char* channel_name(const mailbox_t *mailbox_ptr, const char *base, char name[NAME_MAX])
+{
+    if (mailbox_ptr->channel == NULL)
+        return base;
+    snprintf(name, NAME_MAX, "%s_%s", base, mailbox_ptr->channel);
+    return name;
+}
+
+/**
+ * @brief Open the "/sender" and "/receiver" semaphores, the sender creates them with "/receiver" at receiver_count
+ *
+ * @return int
+ * Return 0 on success, -1 on error
+ */
+int transport_open_semaphores(mailbox_t *mailbox_ptr, int role, unsigned int receiver_count)
+{
+    char send_buffer[NAME_MAX], receive_buffer[NAME_MAX];
+    const char *send_name = channel_name(mailbox_ptr, "/sender", send_buffer);
+    const char *receive_name = channel_name(mailbox_ptr, "/receiver", receive_buffer);
+
+    if (role == ROLE_SENDER) {
+        // Start from fresh semaphores, a run that died half way leaves its counts behind
+        sem_unlink(send_name);
+        sem_unlink(receive_name);
+        mailbox_ptr->sem_send = sem_open(send_name, O_CREAT, 0666, 0);
+        mailbox_ptr->sem_receive = sem_open(receive_name, O_CREAT, 0666, receiver_count);
+    } else {
+        mailbox_ptr->sem_send = sem_open(send_name, 0);
+        mailbox_ptr->sem_receive = sem_open(receive_name, 0);
+    }
+    if (mailbox_ptr->sem_send == SEM_FAILED || mailbox_ptr->sem_receive == SEM_FAILED) {
+        perror("sem_open");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Close the semaphores and remove their names, both ends do it and the later unlink finds nothing
+ */
+void transport_close_semaphores(mailbox_t *mailbox_ptr)
+{
+    char name[NAME_MAX];
+
+    sem_close(mailbox_ptr->sem_send);
+    sem_close(mailbox_ptr->sem_receive);
+    sem_unlink(channel_name(mailbox_ptr, "/sender", name));
+    sem_unlink(channel_name(mailbox_ptr, "/receiver", name));
+}
+
+/**
+ * @brief Sender: create the START_READY semaphore, before the transport is opened so a receiver never posts a stale one
+ *
+ * @return sem_t*
+ * Return the semaphore, SEM_FAILED on error
+ */
+sem_t* transport_open_ready(const mailbox_t *mailbox_ptr)
+{
+    char buffer[NAME_MAX];
+    const char *name = channel_name(mailbox_ptr, START_READY, buffer);
+    sem_t *ready;
+
+    sem_unlink(name);
+    ready = sem_open(name, O_CREAT, 0666, 0);
+    if (ready == SEM_FAILED)
+        perror("sem_open " START_READY);
+    return ready;
+}
+
+/**
+ * @brief Sender: wait until a receiver has opened its end, so nothing is timed while it is still starting up
+ */
+void transport_wait_ready(const mailbox_t *mailbox_ptr, sem_t *ready)
+{
+    char name[NAME_MAX];
+
+    sem_wait(ready);
+    sem_close(ready);
+    sem_unlink(channel_name(mailbox_ptr, START_READY, name));
+}
+
+/**
+ * @brief Receiver: tell a sender started with -g that this end is open, nothing to do if none waits
+ */
+void transport_post_ready(const mailbox_t *mailbox_ptr)
+{
+    char name[NAME_MAX];
+    sem_t *ready = sem_open(channel_name(mailbox_ptr, START_READY, name), 0);
+
+    if (ready == SEM_FAILED)
+        return;
+    sem_post(ready);
+    sem_close(ready);
+}
+
+/**
+ * @brief Open the channel's stats page for ./monitor, a single sender starts it afresh
+ *
+ * @return int
+ * Return 0 on success, -1 on error
+ */
+int transport_open_stats(mailbox_t *mailbox_ptr, int role)
+{
+    char buffer[NAME_MAX];
+    const char *name = channel_name(mailbox_ptr, STATS_PAGE, buffer);
+    stats_page_t *page;
+
+    if (role == ROLE_SENDER) {
+        // Senders sharing the MPMC queue share the page too, the first one creates it
+        if (mailbox_ptr->producers <= 1)
+            shm_unlink(name);
+        page = stats_page_map(name, O_CREAT | O_RDWR);
+        if (page == NULL)
+            return -1;
+        strncpy(page->transport, mailbox_ptr->transport->name, sizeof(page->transport) - 1);
+        atomic_store_explicit(&page->magic, STATS_MAGIC, memory_order_release);
+    } else {
+        // Normally the sender's, a reader of the latest value may come after the writer left and took it along
+        page = stats_page_map(name, O_CREAT | O_RDWR);
+        if (page == NULL)
+            return -1;
+        if (atomic_load_explicit(&page->magic, memory_order_acquire) != STATS_MAGIC) {
+            strncpy(page->transport, mailbox_ptr->transport->name, sizeof(page->transport) - 1);
+            atomic_store_explicit(&page->magic, STATS_MAGIC, memory_order_release);
+        }
+    }
+
+    mailbox_ptr->page = page;
+    mailbox_ptr->live = role == ROLE_SENDER ? &page->sender : &page->receiver;
+    atomic_fetch_add(&mailbox_ptr->live->attached, 1);
+    return 0;
+}
+
+/**
+ * @brief Publish the final counts and leave the stats page, the last end to leave removes it
+ */
+void transport_close_stats(mailbox_t *mailbox_ptr)
+{
+    stats_page_t *page = mailbox_ptr->page;
+    char name[NAME_MAX];
+
+    if (page == NULL)
+        return;
+    stats_publish(mailbox_ptr);
+    atomic_fetch_add(&mailbox_ptr->live->closed, 1);
+    // A monitor still has it mapped and shows the totals
+    if (atomic_load(&page->sender.closed) == atomic_load(&page->sender.attached) &&
+        atomic_load(&page->receiver.closed) == atomic_load(&page->receiver.attached))
+        shm_unlink(channel_name(mailbox_ptr, STATS_PAGE, name));
+    munmap(page, sizeof(stats_page_t));
+    mailbox_ptr->page = NULL;
+    mailbox_ptr->live = NULL;
+}
+
+/**
+ * @brief Path of the segment name on the hugetlbfs mount huge_dir
+ */
+static const char* huge_path(const mailbox_t *mailbox_ptr, const char *name, char path[PATH_MAX])
+{
+    snprintf(path, PATH_MAX, "%s%s", mailbox_ptr->huge_dir, name);
+    return path;
+}
+
+/**
+ * @brief Open name in huge_dir on hugetlbfs, or as POSIX shm when huge is 0
+ */
+static int segment_fd(const mailbox_t *mailbox_ptr, const char *name, int huge, int oflag)
+{
+    char path[PATH_MAX];
+
+    if (!huge)
+        return shm_open(name, oflag, 0666);
+    return open(huge_path(mailbox_ptr, name, path), oflag | O_CLOEXEC, 0666);
+}
+
+/**
+ * @brief size rounded up to the page size of fd's file system, huge pages on hugetlbfs
+ */
+static size_t segment_round(int fd, size_t size)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) == -1 || st.st_blksize <= 0)
+        return size;
+    return (size + st.st_blksize - 1) / st.st_blksize * st.st_blksize;
+}
+
+/**
+ * @brief Map the segment name, size bytes, creating it for the sender
+ *
+ * With huge_dir set the segment is a file on that hugetlbfs mount, and if huge pages cannot be had
+ * it falls back to POSIX shm with transparent huge pages advised.
+ * The mapped size is kept in segment_size for segment_unmap().
+ *
+ * @param wipe Zero what an earlier run left behind, otherwise keep an existing segment as it is
+ * @return void*
+ * Return the mapping, NULL on error
+ */
+void* segment_create(mailbox_t *mailbox_ptr, const char *name, size_t size, int wipe)
+{
+    void *addr;
+
+    for (int huge = mailbox_ptr->huge_dir != NULL; huge >= 0; --huge) {
+        int fd = segment_fd(mailbox_ptr, name, huge, O_CREAT | O_RDWR);
+        struct statfs fs;
+        if (fd == -1) {
+            perror(huge ? "open hugetlbfs" : "shm_open");
+            continue;
+        }
+        // Any other file system would quietly hand out normal pages
+        if (huge && (fstatfs(fd, &fs) == -1 || fs.f_type != HUGETLBFS_MAGIC)) {
+            char path[PATH_MAX];
+
+            fprintf(stderr, "%s: not a hugetlbfs mount\n", mailbox_ptr->huge_dir);
+            close(fd);
+            unlink(huge_path(mailbox_ptr, name, path));
+            continue;
+        }
+
+        size_t length = huge ? segment_round(fd, size) : size;
+        if ((wipe && ftruncate(fd, 0) == -1) || ftruncate(fd, length) == -1) {
+            perror("shm_ftruncate");
+            close(fd);
+            continue;
+        }
+        addr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            // On hugetlbfs this is where a pool without free huge pages shows up
+            char path[PATH_MAX];
+
+            perror("mmap");
+            if (huge)
+                unlink(huge_path(mailbox_ptr, name, path));
+            continue;
+        }
+
+        mailbox_ptr->segment_huge = huge;
+        mailbox_ptr->segment_size = length;
+        if (huge) {
+            // A receiver started without -H looks in POSIX shm, leave nothing stale there for it
+            shm_unlink(name);
+        } else if (mailbox_ptr->huge_dir != NULL) {
+            char path[PATH_MAX];
+
+            unlink(huge_path(mailbox_ptr, name, path));
+            fprintf(stderr, "%s: no huge pages in %s, using POSIX shm with transparent huge pages advised\n",
+                    name + 1, mailbox_ptr->huge_dir);
+            madvise(addr, length, MADV_HUGEPAGE);
+        }
+        return addr;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Map the segment name the sender created, looking in huge_dir first if set
+ *
+ * @param missing What to tell the user when the segment is missing or too small
+ * @return void*
+ * Return the mapping, NULL on error
+ */
+void* segment_attach(mailbox_t *mailbox_ptr, const char *name, size_t size, const char *missing)
+{
+    struct stat st;
+    int huge = mailbox_ptr->huge_dir != NULL;
+    int fd = segment_fd(mailbox_ptr, name, huge, O_RDWR);
+
+    if (fd == -1 && huge) {
+        huge = 0;
+        fd = segment_fd(mailbox_ptr, name, huge, O_RDWR);
+    }
+    if (fd == -1) {
+        perror("shm_open");
+        return NULL;
+    }
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)size) {
+        fprintf(stderr, "%s: %s\n", name + 1, missing);
+        close(fd);
+        return NULL;
+    }
+
+    size_t length = huge ? segment_round(fd, size) : size;
+    void *addr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+    mailbox_ptr->segment_huge = huge;
+    mailbox_ptr->segment_size = length;
+    return addr;
+}
+
+/**
+ * @brief Unmap a segment from segment_create() or segment_attach()
+ */
+void segment_unmap(mailbox_t *mailbox_ptr, void *addr)
+{
+    munmap(addr, mailbox_ptr->segment_size);
+}
+
+/**
+ * @brief Remove the segment name from wherever it was created
+ */
+void segment_unlink(const mailbox_t *mailbox_ptr, const char *name)
+{
+    char path[PATH_MAX];
+
+    if (mailbox_ptr->segment_huge)
+        unlink(huge_path(mailbox_ptr, name, path));
+    else
+        shm_unlink(name);
+}
+
+/**
+ * @brief Keep this process on cpu, so a run measures one placement instead of wherever the scheduler moves it
+ *
+ * @return int
+ * Return 0 on success, -1 on error
+ */
+int pin_to_cpu(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+        perror("sched_setaffinity");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Address of name in the abstract namespace, nothing to unlink afterwards
+ */
+static socklen_t unix_address(struct sockaddr_un *addr, const char *name)
+{
+    size_t length = strlen(name);
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (length > sizeof(addr->sun_path) - 1)
+        length = sizeof(addr->sun_path) - 1;
+    memcpy(addr->sun_path + 1, name, length);
+    return offsetof(struct sockaddr_un, sun_path) + 1 + length;
+}
+
+/**
+ * @brief Wait for one peer on the abstract AF_UNIX socket name
+ *
+ * @param type SOCK_STREAM or SOCK_SEQPACKET
+ * @return int
+ * Return the connected socket, -1 on error
+ */
+int unix_listen(const char *name, int type)
+{
+    struct sockaddr_un addr;
+    socklen_t length = unix_address(&addr, name);
+    int listener = socket(AF_UNIX, type | SOCK_CLOEXEC, 0);
+    int fd;
+
+    if (listener == -1) {
+        perror("socket");
+        return -1;
+    }
+    if (bind(listener, (struct sockaddr *)&addr, length) == -1 || listen(listener, 1) == -1) {
+        perror("bind");
+        close(listener);
+        return -1;
+    }
+    fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+    if (fd == -1)
+        perror("accept");
+    close(listener);
+    return fd;
+}
+
+/**
+ * @brief Connect to the peer listening on the abstract AF_UNIX socket name
+ *
+ * @return int
+ * Return the connected socket, -1 on error
+ */
+int unix_connect(const char *name, int type)
+{
+    struct sockaddr_un addr;
+    socklen_t length = unix_address(&addr, name);
+    int fd = socket(AF_UNIX, type | SOCK_CLOEXEC, 0);
+
+    if (fd == -1) {
+        perror("socket");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, length) == -1) {
+        perror("connect");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Hand count descriptors to the receiver that connects to name, waiting for it
+ *
+ * @return int
+ * Return 0 on success, -1 on error
+ */
+int send_fds(const char *name, const int *fds, int count)
+{
+    char control[CMSG_SPACE(4 * sizeof(int))];
+    char byte = 0;
+    struct iovec iov = {&byte, 1};
+    struct msghdr msg = {0};
+    struct cmsghdr *cmsg;
+    int fd = unix_listen(name, SOCK_STREAM);
+
+    if (fd == -1)
+        return -1;
+
+    memset(control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(count * sizeof(int));
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, count * sizeof(int));
+
+    if (sendmsg(fd, &msg, 0) == -1) {
+        perror("sendmsg");
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+/**
+ * @brief Receive count descriptors from the sender listening on name
+ *
+ * @return int
+ * Return 0 on success, -1 on error
+ */
+int receive_fds(const char *name, int *fds, int count)
+{
+    char control[CMSG_SPACE(4 * sizeof(int))];
+    char byte;
+    struct iovec iov = {&byte, 1};
+    struct msghdr msg = {0};
+    struct cmsghdr *cmsg;
+    int fd = unix_connect(name, SOCK_STREAM);
+
+    if (fd == -1)
+        return -1;
+
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(count * sizeof(int));
+    if (recvmsg(fd, &msg, MSG_CMSG_CLOEXEC) <= 0) {
+        perror("recvmsg");
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(count * sizeof(int))) {
+        fprintf(stderr, "%s: no descriptors received\n", name);
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), count * sizeof(int));
+    return 0;
+}
@@ -0,0 +1,85 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdio.h>
+
+#include "mailbox.h"
+
+#define ROLE_SENDER 0
+#define ROLE_RECEIVER 1
+
+#define START_READY "/start_ready"    // posted by a receiver once open, a sender started with -g waits for it
+
+/*
+ * One way of moving frames from the sender to the receiver.
+ * open and close run on both ends, role tells which one.
+ * Frame transports fill in claim/send on the sender and recv/release on the receiver,
+ * byte stream transports (mechanisms 5 and 10) move the whole input file with send_file/recv_file instead.
+ * Transports a receiver can multiplex with others (see mux.c) also fill in watch and ready.
+ * Every operation that can fail prints the reason with perror and returns -1.
+ */
+typedef struct transport {
+    int id;                  // mechanism number accepted on the command line, kept in mailbox_t.flag
+    const char *name;        // mechanism name accepted on the command line
+    const char *label;       // printed by both ends once the transport is open
+    int (*open)(mailbox_t *mailbox_ptr, int role);
+    frame_t *(*claim)(mailbox_t *mailbox_ptr);                   // frame the next records go into
+    int (*send)(mailbox_t *mailbox_ptr, frame_t *frame);         // publish a claimed frame
+    frame_t *(*recv)(mailbox_t *mailbox_ptr);                    // next frame, NULL once every sender is done
+    void (*release)(mailbox_t *mailbox_ptr, frame_t *frame);     // done with the frame recv returned
+    int (*watch)(mailbox_t *mailbox_ptr);                        // descriptor readable whenever a frame may have arrived, -1 if none
+    int (*ready)(mailbox_t *mailbox_ptr, int woken);             // recv would not block; woken: the watched descriptor fired, reset it
+    int (*send_file)(mailbox_t *mailbox_ptr, const char *input_file);
+    int (*recv_file)(mailbox_t *mailbox_ptr, const char *output_file);
+    void (*close)(mailbox_t *mailbox_ptr, int role);
+    void (*stats)(const mailbox_t *mailbox_ptr, int role);
+} transport_t;
+
+// Defined by sender.c and receiver.c, transports add the time spent moving data, each thread its own
+extern _Thread_local double time_taken;
+
+extern const transport_t transport_mq;
+extern const transport_t transport_shm;
+extern const transport_t transport_ring;
+extern const transport_t transport_mpmc;
+extern const transport_t transport_stream;
+extern const transport_t transport_pipe;
+extern const transport_t transport_fifo;
+extern const transport_t transport_seqpacket;
+extern const transport_t transport_eventfd;
+extern const transport_t transport_splice;
+extern const transport_t transport_lanes;
+extern const transport_t transport_seqlock;
+extern const transport_t transport_arena;
+extern const transport_t transport_broadcast;
+extern const transport_t transport_auto;
+
+const transport_t* transport_find(const char *mechanism);
+void transport_usage(FILE *stream);
+
+frame_t* transport_staging_frame(mailbox_t *mailbox_ptr);
+void transport_stats(const mailbox_t *mailbox_ptr, int role);
+void transport_account(mailbox_t *mailbox_ptr, const struct timespec *start, size_t frame_size);
+void transport_sem_wait(mailbox_t *mailbox_ptr, sem_t *sem);
+void transport_poll(mailbox_t *mailbox_ptr, int fd, short events);
+const char* channel_name(const mailbox_t *mailbox_ptr, const char *base, char name[NAME_MAX]);
+int transport_open_semaphores(mailbox_t *mailbox_ptr, int role, unsigned int receiver_count);
+void transport_close_semaphores(mailbox_t *mailbox_ptr);
+sem_t* transport_open_ready(const mailbox_t *mailbox_ptr);
+void transport_wait_ready(const mailbox_t *mailbox_ptr, sem_t *ready);
+void transport_post_ready(const mailbox_t *mailbox_ptr);
+int transport_open_stats(mailbox_t *mailbox_ptr, int role);
+void transport_close_stats(mailbox_t *mailbox_ptr);
+
+void* segment_create(mailbox_t *mailbox_ptr, const char *name, size_t size, int wipe);
+void* segment_attach(mailbox_t *mailbox_ptr, const char *name, size_t size, const char *missing);
+void segment_unmap(mailbox_t *mailbox_ptr, void *addr);
+void segment_unlink(const mailbox_t *mailbox_ptr, const char *name);
+int pin_to_cpu(int cpu);
+
+int unix_listen(const char *name, int type);
+int unix_connect(const char *name, int type);
+int send_fds(const char *name, const int *fds, int count);
+int receive_fds(const char *name, int *fds, int count);
+
+#endif
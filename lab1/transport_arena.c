@@ -0,0 +1,138 @@
+#include <stddef.h>
+
+#include "transport.h"
+#include "arena.h"
+
+/*
+ * Mechanism 13, frames in blocks of a shared arena and only their handles through an SPSC ring.
+ * Each frame takes a block of its own size class, split off a larger one if need be, so a frame
+ * of one short message does not hold a slot sized for the largest, and the receiver reads it in
+ * place before freeing the block.
+ */
+
+#define ARENA_SEGMENT_SIZE (offsetof(arena_segment_t, arena) + ARENA_SIZE)
+
+static int arena_transport_open(mailbox_t *mailbox_ptr, int role)
+{
+    char segment[NAME_MAX];
+    arena_segment_t *shared;
+
+    mailbox_ptr->sem_send = NULL;
+    mailbox_ptr->sem_receive = NULL;
+
+    if (role == ROLE_SENDER)
+        shared = segment_create(mailbox_ptr, channel_name(mailbox_ptr, "/shm_arena", segment), ARENA_SEGMENT_SIZE, 1);
+    else
+        shared = segment_attach(mailbox_ptr, channel_name(mailbox_ptr, "/shm_arena", segment), ARENA_SEGMENT_SIZE,
+                                "arena is not set up, start the sender first");
+    if (shared == NULL)
+        return -1;
+    mailbox_ptr->storage.arena = shared;
+
+    if (role == ROLE_SENDER) {
+        arena_init(&shared->arena, ARENA_SIZE);
+        shared->spin_budget = mailbox_ptr->spin_budget;
+        atomic_store_explicit(&shared->magic, RING_MAGIC, memory_order_release);
+        return 0;
+    }
+
+    if (atomic_load_explicit(&shared->magic, memory_order_acquire) != RING_MAGIC) {
+        fprintf(stderr, "shm_arena: arena is not set up, start the sender first\n");
+        return -1;
+    }
+    if (mailbox_ptr->spin_budget == SPIN_BUDGET_UNSET)
+        mailbox_ptr->spin_budget = shared->spin_budget;
+    return 0;
+}
+
+static int arena_transport_send(mailbox_t *mailbox_ptr, frame_t *frame)
+{
+    /*
+        Copy the frame into a block of just its size and queue the block's handle.
+        The block is freed by the receiver once it has read the frame.
+    */
+    arena_segment_t *shared = mailbox_ptr->storage.arena;
+    unsigned long head = atomic_load_explicit(&shared->head, memory_order_relaxed);
+    size_t frame_size = FRAME_HEADER_SIZE + frame->length;
+    struct timespec start;
+    uint32_t block;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    mailbox_ptr->sleeps += wait_while_equal(&shared->tail, head - ARENA_HANDLES, &shared->space,
+                                            WAIT_FUTEX, mailbox_ptr->spin_budget);
+    block = arena_alloc_wait(&shared->arena, frame_size, mailbox_ptr->spin_budget, &mailbox_ptr->sleeps);
+    if (block == ARENA_NONE) {
+        fprintf(stderr, "shm_arena: no block of %zu bytes can ever be free\n", frame_size);
+        return -1;
+    }
+    memcpy(arena_ptr(&shared->arena, block), frame, frame_size);
+
+    shared->handles[head & (ARENA_HANDLES - 1)] = block;
+    atomic_store_explicit(&shared->head, head + 1, memory_order_release);
+    waitpoint_wake(&shared->data);
+    transport_account(mailbox_ptr, &start, frame_size);
+    return 0;
+}
+
+static frame_t* arena_transport_recv(mailbox_t *mailbox_ptr)
+{
+    // Wait for a handle, the frame is read where it lies in the arena
+    arena_segment_t *shared = mailbox_ptr->storage.arena;
+    unsigned long tail = atomic_load_explicit(&shared->tail, memory_order_relaxed);
+
+    mailbox_ptr->sleeps += wait_while_equal(&shared->head, tail, &shared->data,
+                                            WAIT_FUTEX, mailbox_ptr->spin_budget);
+    return arena_ptr(&shared->arena, shared->handles[tail & (ARENA_HANDLES - 1)]);
+}
+
+static void arena_transport_release(mailbox_t *mailbox_ptr, frame_t *frame)
+{
+    // Free the block for the sender's next frame of its class, then the handle slot
+    arena_segment_t *shared = mailbox_ptr->storage.arena;
+    unsigned long tail = atomic_load_explicit(&shared->tail, memory_order_relaxed);
+    size_t frame_size = FRAME_HEADER_SIZE + frame->length;   // the block is the sender's again once freed
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    arena_free(&shared->arena, shared->handles[tail & (ARENA_HANDLES - 1)]);
+    atomic_store_explicit(&shared->tail, tail + 1, memory_order_release);
+    waitpoint_wake(&shared->space);
+    transport_account(mailbox_ptr, &start, frame_size);
+}
+
+static void arena_transport_close(mailbox_t *mailbox_ptr, int role)
+{
+    arena_segment_t *shared = mailbox_ptr->storage.arena;
+    char segment[NAME_MAX];
+
+    // Keep the segment alive until the receiver has drained the exit message, asleep on space like a full ring
+    if (role == ROLE_SENDER) {
+        unsigned long head = atomic_load_explicit(&shared->head, memory_order_relaxed), tail;
+
+        while ((tail = atomic_load_explicit(&shared->tail, memory_order_acquire)) != head)
+            mailbox_ptr->sleeps += wait_while_equal(&shared->tail, tail, &shared->space, WAIT_FUTEX,
+                                                    mailbox_ptr->spin_budget);
+    }
+    segment_unmap(mailbox_ptr, shared);
+    segment_unlink(mailbox_ptr, channel_name(mailbox_ptr, "/shm_arena", segment));
+}
+
+static void arena_transport_stats(const mailbox_t *mailbox_ptr, int role)
+{
+    transport_stats(mailbox_ptr, role);
+    if (role == ROLE_SENDER)
+        arena_stats(&mailbox_ptr->storage.arena->arena);
+}
+
+const transport_t transport_arena = {
+    .id = 13,
+    .name = "arena",
+    .label = "Share Memory Arena",
+    .open = arena_transport_open,
+    .claim = transport_staging_frame,
+    .send = arena_transport_send,
+    .recv = arena_transport_recv,
+    .release = arena_transport_release,
+    .close = arena_transport_close,
+    .stats = arena_transport_stats,
+};
@@ -0,0 +1,224 @@
+#include <stdlib.h>
+
+#include "transport.h"
+
+/*
+ * Mechanism 15, the message queue or the ring, whichever suits the traffic.
+ * Both are opened under the channel "auto". The sender samples the messages it sends and,
+ * once AUTO_AGREE windows in a row call for the other transport, sends a MSG_SWITCH frame on
+ * the current one and carries on with the other. Both transports deliver in order, so by the
+ * time the receiver reads the switch frame it has read everything sent before it.
+ *
+ * Sparse, small messages go through the message queue, which blocks in the kernel without
+ * spinning; bursts and large payloads go through the ring, which is filled in place.
+ */
+
+#define AUTO_WINDOW 256          // messages per sample
+#define AUTO_AGREE 2             // samples in a row that must call for the other transport
+#define AUTO_SPARSE_NS 20000     // mean time between messages, outside the transport, from which traffic is sparse
+#define AUTO_LARGE_BYTES 512     // mean payload from which messages are large
+#define AUTO_MQ 0                // adaptive_t.inner[]
+#define AUTO_RING 1
+
+typedef struct adaptive {
+    mailbox_t inner[2];          // the message queue and the ring, each opened as usual
+    char channel[NAME_MAX];
+    unsigned int current;        // AUTO_MQ or AUTO_RING
+    // Sender: the sample being taken
+    uint64_t window_start;
+    uint64_t window_messages;
+    uint64_t window_bytes;
+    uint64_t window_blocked_ns;  // time spent inside the transport, which is not the traffic's own pace
+    unsigned int agree;
+    uint64_t switches;
+} adaptive_t;
+
+static const transport_t *const auto_transports[2] = {&transport_mq, &transport_ring};
+
+static int auto_transport_open(mailbox_t *mailbox_ptr, int role)
+{
+    adaptive_t *adaptive = calloc(1, sizeof(adaptive_t));
+
+    if (adaptive == NULL) {
+        perror("calloc");
+        return -1;
+    }
+    mailbox_ptr->storage.adaptive = adaptive;
+    mailbox_ptr->sem_send = NULL;
+    mailbox_ptr->sem_receive = NULL;
+    if (mailbox_ptr->channel == NULL)
+        snprintf(adaptive->channel, sizeof(adaptive->channel), "auto");
+    else
+        snprintf(adaptive->channel, sizeof(adaptive->channel), "auto_%s", mailbox_ptr->channel);
+
+    // Same settings as this mailbox, apart from the live counters, which this mailbox keeps for both
+    for (int i = 0; i < 2; ++i) {
+        mailbox_t *inner = &adaptive->inner[i];
+
+        memcpy(inner, mailbox_ptr, sizeof(mailbox_t));
+        inner->flag = auto_transports[i]->id;
+        inner->transport = auto_transports[i];
+        inner->channel = adaptive->channel;
+        inner->batch.pending = NULL;
+        inner->page = NULL;
+        inner->live = NULL;
+        if (inner->transport->open(inner, role) == -1)
+            return -1;
+    }
+    adaptive->current = AUTO_MQ;
+    return 0;
+}
+
+static frame_t* auto_transport_claim(mailbox_t *mailbox_ptr)
+{
+    // A frame of the current transport, in place for the ring
+    adaptive_t *adaptive = mailbox_ptr->storage.adaptive;
+    mailbox_t *inner = &adaptive->inner[adaptive->current];
+    uint64_t start = now_ns();
+    frame_t *frame = inner->transport->claim(inner);
+
+    adaptive->window_blocked_ns += now_ns() - start;
+    return frame;
+}
+
+/**
+ * @brief Add a sent frame to the sample and switch transports once enough samples call for it
+ */
+static void auto_sample(mailbox_t *mailbox_ptr, const frame_t *frame)
+{
+    adaptive_t *adaptive = mailbox_ptr->storage.adaptive;
+    mailbox_t *inner = &adaptive->inner[adaptive->current];
+    uint64_t now = now_ns();
+
+    if (adaptive->window_messages == 0)
+        adaptive->window_start = now;
+    adaptive->window_messages += frame->count;
+    adaptive->window_bytes += frame->length - frame->count * RECORD_HEADER_SIZE;
+    if (adaptive->window_messages < AUTO_WINDOW)
+        return;
+
+    uint64_t active_ns = now - adaptive->window_start;
+    uint64_t pace_ns = (active_ns > adaptive->window_blocked_ns ? active_ns - adaptive->window_blocked_ns : 0) /
+                       adaptive->window_messages;
+    uint64_t size = adaptive->window_bytes / adaptive->window_messages;
+    unsigned int want = pace_ns >= AUTO_SPARSE_NS && size < AUTO_LARGE_BYTES ? AUTO_MQ : AUTO_RING;
+
+    adaptive->agree = want != adaptive->current ? adaptive->agree + 1 : 0;
+    if (adaptive->agree >= AUTO_AGREE) {
+        // The last frame on the old transport tells the receiver where the next ones are
+        frame_t *control = inner->transport->claim(inner);
+        control->type = MSG_SWITCH;
+        control->priority = 0;
+        control->count = 0;
+        control->length = 1;
+        control->data[0] = want;
+        inner->transport->send(inner, control);
+
+        printf("Auto: switching to %s, %llu B per message, %.1f us apart over the last %llu messages\n",
+               auto_transports[want]->name, (unsigned long long)size, pace_ns / 1e3,
+               (unsigned long long)adaptive->window_messages);
+        adaptive->current = want;
+        adaptive->agree = 0;
+        adaptive->switches++;
+    }
+    adaptive->window_messages = 0;
+    adaptive->window_bytes = 0;
+    adaptive->window_blocked_ns = 0;
+}
+
+/**
+ * @brief Keep this mailbox's counters the sum of both transports' and bring the stats page up to date
+ */
+static void auto_account(mailbox_t *mailbox_ptr)
+{
+    adaptive_t *adaptive = mailbox_ptr->storage.adaptive;
+
+    mailbox_ptr->frames = adaptive->inner[0].frames + adaptive->inner[1].frames;
+    mailbox_ptr->wire_bytes = adaptive->inner[0].wire_bytes + adaptive->inner[1].wire_bytes;
+    mailbox_ptr->sleeps = adaptive->inner[0].sleeps + adaptive->inner[1].sleeps;
+    stats_publish(mailbox_ptr);
+}
+
+static int auto_transport_send(mailbox_t *mailbox_ptr, frame_t *frame)
+{
+    adaptive_t *adaptive = mailbox_ptr->storage.adaptive;
+    mailbox_t *inner = &adaptive->inner[adaptive->current];
+    uint64_t start = now_ns();
+    int result = inner->transport->send(inner, frame);
+
+    adaptive->window_blocked_ns += now_ns() - start;
+    if (frame->type == MSG_DATA)
+        auto_sample(mailbox_ptr, frame);
+    auto_account(mailbox_ptr);
+    return result;
+}
+
+static frame_t* auto_transport_recv(mailbox_t *mailbox_ptr)
+{
+    /*
+        Next frame of the current transport, following the sender whenever a switch frame comes up.
+        Everything sent before the switch was read by then, so no frame is taken out of order.
+    */
+    adaptive_t *adaptive = mailbox_ptr->storage.adaptive;
+
+    for (;;) {
+        mailbox_t *inner = &adaptive->inner[adaptive->current];
+        frame_t *frame = inner->transport->recv(inner);
+
+        if (frame == NULL || frame->type != MSG_SWITCH) {
+            auto_account(mailbox_ptr);
+            return frame;
+        }
+
+        unsigned int next = frame->data[0];
+        if (inner->transport->release)
+            inner->transport->release(inner, frame);
+        printf("Auto: switched to %s after %llu messages\n", auto_transports[next]->name,
+               (unsigned long long)mailbox_ptr->messages);
+        adaptive->current = next;
+        adaptive->switches++;
+    }
+}
+
+static void auto_transport_release(mailbox_t *mailbox_ptr, frame_t *frame)
+{
+    adaptive_t *adaptive = mailbox_ptr->storage.adaptive;
+    mailbox_t *inner = &adaptive->inner[adaptive->current];
+
+    if (inner->transport->release)
+        inner->transport->release(inner, frame);
+    auto_account(mailbox_ptr);
+}
+
+static void auto_transport_close(mailbox_t *mailbox_ptr, int role)
+{
+    adaptive_t *adaptive = mailbox_ptr->storage.adaptive;
+
+    auto_account(mailbox_ptr);
+    for (int i = 0; i < 2; ++i)
+        adaptive->inner[i].transport->close(&adaptive->inner[i], role);
+    free(adaptive);
+}
+
+static void auto_transport_stats(const mailbox_t *mailbox_ptr, int role)
+{
+    const adaptive_t *adaptive = mailbox_ptr->storage.adaptive;
+
+    transport_stats(mailbox_ptr, role);
+    printf("Auto: %llu switches, %llu frames on mq and %llu on the ring, ended on %s\n",
+           (unsigned long long)adaptive->switches, (unsigned long long)adaptive->inner[AUTO_MQ].frames,
+           (unsigned long long)adaptive->inner[AUTO_RING].frames, auto_transports[adaptive->current]->name);
+}
+
+const transport_t transport_auto = {
+    .id = 15,
+    .name = "auto",
+    .label = "Adaptive Message Queue / Share Memory Ring",
+    .open = auto_transport_open,
+    .claim = auto_transport_claim,
+    .send = auto_transport_send,
+    .recv = auto_transport_recv,
+    .release = auto_transport_release,
+    .close = auto_transport_close,
+    .stats = auto_transport_stats,
+};
@@ -0,0 +1,159 @@
+#include "transport.h"
+
+/*
+ * Mechanism 14, one sender broadcasting to up to BROADCAST_SUBSCRIBERS receivers.
+ * Every frame is written once into a shared ring slot and read in place by all of them,
+ * the slot goes back to the sender once the last subscriber has passed it.
+ */
+
+static int broadcast_transport_open(mailbox_t *mailbox_ptr, int role)
+{
+    char segment[NAME_MAX];
+    broadcast_t *broadcast;
+
+    mailbox_ptr->sem_send = NULL;
+    mailbox_ptr->sem_receive = NULL;
+
+    if (role == ROLE_SENDER)
+        broadcast = segment_create(mailbox_ptr, channel_name(mailbox_ptr, "/shm_broadcast", segment), sizeof(broadcast_t), 1);
+    else
+        broadcast = segment_attach(mailbox_ptr, channel_name(mailbox_ptr, "/shm_broadcast", segment), sizeof(broadcast_t),
+                                   "broadcast is not set up, start the sender first");
+    if (broadcast == NULL)
+        return -1;
+    mailbox_ptr->storage.broadcast = broadcast;
+
+    if (role == ROLE_SENDER) {
+        if (mailbox_ptr->subscribers == 0 || mailbox_ptr->subscribers > BROADCAST_SUBSCRIBERS) {
+            fprintf(stderr, "shm_broadcast: 1 to %d subscribers\n", BROADCAST_SUBSCRIBERS);
+            return -1;
+        }
+        // Only spinning or futexes, every subscriber sleeps on its own waitpoint
+        if (mailbox_ptr->wait_strategy != WAIT_POLL)
+            mailbox_ptr->wait_strategy = WAIT_FUTEX;
+        broadcast->subscribers = mailbox_ptr->subscribers;
+        broadcast->wait_strategy = mailbox_ptr->wait_strategy;
+        broadcast->spin_budget = mailbox_ptr->spin_budget;
+        atomic_store_explicit(&broadcast->magic, RING_MAGIC, memory_order_release);
+
+        // A subscriber joining late would miss the frames before it, so wait for all of them
+        unsigned long registered;
+        while ((registered = atomic_load_explicit(&broadcast->registered, memory_order_acquire)) < broadcast->subscribers)
+            mailbox_ptr->sleeps += wait_while_equal(&broadcast->registered, registered, &broadcast->joined,
+                                                    mailbox_ptr->wait_strategy, mailbox_ptr->spin_budget);
+        return 0;
+    }
+
+    if (atomic_load_explicit(&broadcast->magic, memory_order_acquire) != RING_MAGIC) {
+        fprintf(stderr, "shm_broadcast: broadcast is not set up, start the sender first\n");
+        return -1;
+    }
+    mailbox_ptr->subscribers = atomic_fetch_add_explicit(&broadcast->registered, 1, memory_order_acq_rel);
+    waitpoint_wake(&broadcast->joined);
+    if (mailbox_ptr->subscribers >= broadcast->subscribers) {
+        fprintf(stderr, "shm_broadcast: already has its %u subscribers\n", broadcast->subscribers);
+        return -1;
+    }
+    mailbox_ptr->wait_strategy = broadcast->wait_strategy;
+    if (mailbox_ptr->spin_budget == SPIN_BUDGET_UNSET)
+        mailbox_ptr->spin_budget = broadcast->spin_budget;
+    return 0;
+}
+
+static frame_t* broadcast_transport_claim(mailbox_t *mailbox_ptr)
+{
+    // Filled in place, once the slowest subscriber has passed the slot
+    broadcast_t *broadcast = mailbox_ptr->storage.broadcast;
+    unsigned long head = atomic_load_explicit(&broadcast->head, memory_order_relaxed);
+
+    mailbox_ptr->sleeps += wait_while_equal(&broadcast->reclaimed, head - RING_SLOTS, &broadcast->space,
+                                            mailbox_ptr->wait_strategy, mailbox_ptr->spin_budget);
+    return &broadcast->slots[head & (RING_SLOTS - 1)];
+}
+
+static int broadcast_transport_send(mailbox_t *mailbox_ptr, frame_t *frame)
+{
+    // One reference per subscriber, then publish and wake whichever of them sleep
+    broadcast_t *broadcast = mailbox_ptr->storage.broadcast;
+    unsigned long head = atomic_load_explicit(&broadcast->head, memory_order_relaxed);
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    atomic_store_explicit(&broadcast->refs[head & (RING_SLOTS - 1)], broadcast->subscribers, memory_order_relaxed);
+    atomic_store_explicit(&broadcast->head, head + 1, memory_order_release);
+    if (mailbox_ptr->wait_strategy == WAIT_FUTEX)
+        for (unsigned int i = 0; i < broadcast->subscribers; ++i)
+            waitpoint_wake(&broadcast->subscriber[i].data);
+    transport_account(mailbox_ptr, &start, FRAME_HEADER_SIZE + frame->length);
+    return 0;
+}
+
+static frame_t* broadcast_transport_recv(mailbox_t *mailbox_ptr)
+{
+    // This subscriber's next slot, read in place
+    broadcast_t *broadcast = mailbox_ptr->storage.broadcast;
+    subscriber_t *self = &broadcast->subscriber[mailbox_ptr->subscribers];
+    unsigned long cursor = atomic_load_explicit(&self->cursor, memory_order_relaxed);
+
+    mailbox_ptr->sleeps += wait_while_equal(&broadcast->head, cursor, &self->data,
+                                            mailbox_ptr->wait_strategy, mailbox_ptr->spin_budget);
+    return &broadcast->slots[cursor & (RING_SLOTS - 1)];
+}
+
+static void broadcast_transport_release(mailbox_t *mailbox_ptr, frame_t *frame)
+{
+    // Move on and drop the reference, the last subscriber to pass the slot hands it back
+    broadcast_t *broadcast = mailbox_ptr->storage.broadcast;
+    subscriber_t *self = &broadcast->subscriber[mailbox_ptr->subscribers];
+    unsigned long cursor = atomic_load_explicit(&self->cursor, memory_order_relaxed);
+    size_t frame_size = FRAME_HEADER_SIZE + frame->length;   // the slot may be the sender's again after the drop
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    atomic_store_explicit(&self->cursor, cursor + 1, memory_order_relaxed);
+    if (atomic_fetch_sub_explicit(&broadcast->refs[cursor & (RING_SLOTS - 1)], 1, memory_order_acq_rel) == 1) {
+        atomic_fetch_add_explicit(&broadcast->reclaimed, 1, memory_order_release);
+        if (mailbox_ptr->wait_strategy == WAIT_FUTEX)
+            waitpoint_wake(&broadcast->space);
+    }
+    transport_account(mailbox_ptr, &start, frame_size);
+}
+
+static void broadcast_transport_close(mailbox_t *mailbox_ptr, int role)
+{
+    broadcast_t *broadcast = mailbox_ptr->storage.broadcast;
+    char segment[NAME_MAX];
+
+    // Keep the segment alive until every subscriber has passed the exit message, asleep on space like a full ring
+    if (role == ROLE_SENDER) {
+        unsigned long head = atomic_load_explicit(&broadcast->head, memory_order_relaxed), reclaimed;
+
+        while ((reclaimed = atomic_load_explicit(&broadcast->reclaimed, memory_order_acquire)) != head)
+            mailbox_ptr->sleeps += wait_while_equal(&broadcast->reclaimed, reclaimed, &broadcast->space,
+                                                    mailbox_ptr->wait_strategy, mailbox_ptr->spin_budget);
+    }
+    segment_unmap(mailbox_ptr, broadcast);
+    segment_unlink(mailbox_ptr, channel_name(mailbox_ptr, "/shm_broadcast", segment));
+}
+
+static void broadcast_transport_stats(const mailbox_t *mailbox_ptr, int role)
+{
+    transport_stats(mailbox_ptr, role);
+    if (role == ROLE_SENDER)
+        printf("Broadcast to %u subscribers, every frame written once\n", mailbox_ptr->subscribers);
+    else
+        printf("Subscriber %u\n", mailbox_ptr->subscribers);
+}
+
+const transport_t transport_broadcast = {
+    .id = 14,
+    .name = "broadcast",
+    .label = "Share Memory Broadcast",
+    .open = broadcast_transport_open,
+    .claim = broadcast_transport_claim,
+    .send = broadcast_transport_send,
+    .recv = broadcast_transport_recv,
+    .release = broadcast_transport_release,
+    .close = broadcast_transport_close,
+    .stats = broadcast_transport_stats,
+};
@@ -0,0 +1,203 @@
+#include "transport.h"
+
+/*
+ * Mechanism 11, one shared memory ring per priority.
+ * The receiver takes the most urgent frame waiting, except that a lane passed over
+ * STARVATION_LIMIT times in a row while it had frames is served next, so bulk data keeps moving.
+ */
+
+static int lanes_transport_open(mailbox_t *mailbox_ptr, int role)
+{
+    char segment[NAME_MAX];
+    lanes_t *lanes;
+
+    mailbox_ptr->sem_send = NULL;
+    mailbox_ptr->sem_receive = NULL;
+
+    if (role == ROLE_SENDER)
+        lanes = segment_create(mailbox_ptr, channel_name(mailbox_ptr, "/shm_lanes", segment), sizeof(lanes_t), 1);
+    else
+        lanes = segment_attach(mailbox_ptr, channel_name(mailbox_ptr, "/shm_lanes", segment), sizeof(lanes_t),
+                               "lanes are not set up, start the sender first");
+    if (lanes == NULL)
+        return -1;
+    mailbox_ptr->storage.lanes = lanes;
+
+    if (role == ROLE_SENDER) {
+        // Only spinning or futexes, the lanes share one place to sleep per direction
+        if (mailbox_ptr->wait_strategy != WAIT_POLL)
+            mailbox_ptr->wait_strategy = WAIT_FUTEX;
+        lanes->wait_strategy = mailbox_ptr->wait_strategy;
+        lanes->spin_budget = mailbox_ptr->spin_budget;
+        atomic_store_explicit(&lanes->magic, RING_MAGIC, memory_order_release);
+        return 0;
+    }
+
+    if (atomic_load_explicit(&lanes->magic, memory_order_acquire) != RING_MAGIC) {
+        fprintf(stderr, "shm_lanes: lanes are not set up, start the sender first\n");
+        return -1;
+    }
+    mailbox_ptr->wait_strategy = lanes->wait_strategy;
+    if (mailbox_ptr->spin_budget == SPIN_BUDGET_UNSET)
+        mailbox_ptr->spin_budget = lanes->spin_budget;
+    return 0;
+}
+
+static frame_t* lanes_transport_claim(mailbox_t *mailbox_ptr)
+{
+    // A slot in the lane of the priority the batch is at, waiting until that lane has room
+    lanes_t *lanes = mailbox_ptr->storage.lanes;
+    lane_t *lane = &lanes->lanes[mailbox_ptr->batch.priority];
+    unsigned long head = atomic_load_explicit(&lane->head, memory_order_relaxed);
+
+    mailbox_ptr->sleeps += wait_while_equal(&lane->tail, head - LANE_SLOTS, &lanes->space,
+                                            mailbox_ptr->wait_strategy, mailbox_ptr->spin_budget);
+    return &lane->slots[head & (LANE_SLOTS - 1)];
+}
+
+static int lanes_transport_send(mailbox_t *mailbox_ptr, frame_t *frame)
+{
+    // Publish in the lane first, so a receiver that sees published move finds the frame
+    lanes_t *lanes = mailbox_ptr->storage.lanes;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    atomic_fetch_add_explicit(&lanes->lanes[frame->priority].head, 1, memory_order_release);
+    atomic_fetch_add_explicit(&lanes->published, 1, memory_order_release);
+    if (mailbox_ptr->wait_strategy == WAIT_FUTEX)
+        waitpoint_wake(&lanes->data);
+    transport_account(mailbox_ptr, &start, FRAME_HEADER_SIZE + frame->length);
+    return 0;
+}
+
+/**
+ * @brief Lane to serve next, -1 if all are empty
+ *
+ * The exit frame is last in lane 0 and only taken once the other lanes are empty.
+ */
+static int lanes_pick(mailbox_t *mailbox_ptr)
+{
+    lanes_t *lanes = mailbox_ptr->storage.lanes;
+    lane_state_t *state = &mailbox_ptr->lanes;
+    int waiting[PRIORITY_LEVELS];
+    int pick = -1;
+
+    for (int p = PRIORITY_LEVELS - 1; p >= 0; --p) {
+        lane_t *lane = &lanes->lanes[p];
+        waiting[p] = atomic_load_explicit(&lane->head, memory_order_acquire) !=
+                     atomic_load_explicit(&lane->tail, memory_order_relaxed);
+        if (!waiting[p])
+            continue;
+        if (pick == -1)
+            pick = p;
+        else if (state->passed_over[p] >= STARVATION_LIMIT && state->passed_over[pick] < STARVATION_LIMIT)
+            pick = p;
+    }
+    if (pick == -1)
+        return -1;
+
+    // Whatever is in the other lanes was sent before the exit frame. Their heads are read again:
+    // the snapshot above took them before lane 0's, so a frame published in between is only seen now.
+    if (pick == 0) {
+        lane_t *lane = &lanes->lanes[0];
+        if (lane->slots[atomic_load_explicit(&lane->tail, memory_order_relaxed) & (LANE_SLOTS - 1)].type == MSG_EXIT)
+            for (int p = PRIORITY_LEVELS - 1; p > 0; --p) {
+                waiting[p] = atomic_load_explicit(&lanes->lanes[p].head, memory_order_acquire) !=
+                             atomic_load_explicit(&lanes->lanes[p].tail, memory_order_relaxed);
+                if (waiting[p]) {
+                    pick = p;
+                    break;
+                }
+            }
+    }
+
+    for (int p = 0; p < PRIORITY_LEVELS; ++p) {
+        if (p == pick || !waiting[p])
+            state->passed_over[p] = 0;
+        else
+            state->passed_over[p]++;
+    }
+    for (int p = pick + 1; p < PRIORITY_LEVELS; ++p)
+        if (waiting[p]) {
+            state->rescued++;
+            break;
+        }
+    return pick;
+}
+
+static frame_t* lanes_transport_recv(mailbox_t *mailbox_ptr)
+{
+    // Sleep only while nothing is published in any lane, then read the chosen slot in place
+    lanes_t *lanes = mailbox_ptr->storage.lanes;
+    lane_state_t *state = &mailbox_ptr->lanes;
+    int pick;
+
+    mailbox_ptr->sleeps += wait_while_equal(&lanes->published, state->consumed, &lanes->data,
+                                            mailbox_ptr->wait_strategy, mailbox_ptr->spin_budget);
+    pick = lanes_pick(mailbox_ptr);
+    state->current = pick;
+    state->frames[pick]++;
+
+    lane_t *lane = &lanes->lanes[pick];
+    return &lane->slots[atomic_load_explicit(&lane->tail, memory_order_relaxed) & (LANE_SLOTS - 1)];
+}
+
+static void lanes_transport_release(mailbox_t *mailbox_ptr, frame_t *frame)
+{
+    // Hand the slot back to its lane
+    lanes_t *lanes = mailbox_ptr->storage.lanes;
+    size_t frame_size = FRAME_HEADER_SIZE + frame->length;   // the slot is the sender's again after the add
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    atomic_fetch_add_explicit(&lanes->lanes[mailbox_ptr->lanes.current].tail, 1, memory_order_release);
+    mailbox_ptr->lanes.consumed++;
+    if (mailbox_ptr->wait_strategy == WAIT_FUTEX)
+        waitpoint_wake(&lanes->space);
+    transport_account(mailbox_ptr, &start, frame_size);
+}
+
+static void lanes_transport_close(mailbox_t *mailbox_ptr, int role)
+{
+    lanes_t *lanes = mailbox_ptr->storage.lanes;
+    char segment[NAME_MAX];
+
+    // Keep the segment alive until the receiver has drained every lane, asleep on space like a full lane
+    if (role == ROLE_SENDER)
+        for (int p = 0; p < PRIORITY_LEVELS; ++p) {
+            lane_t *lane = &lanes->lanes[p];
+            unsigned long head = atomic_load_explicit(&lane->head, memory_order_relaxed), tail;
+
+            while ((tail = atomic_load_explicit(&lane->tail, memory_order_acquire)) != head)
+                mailbox_ptr->sleeps += wait_while_equal(&lane->tail, tail, &lanes->space,
+                                                        mailbox_ptr->wait_strategy, mailbox_ptr->spin_budget);
+        }
+    segment_unmap(mailbox_ptr, lanes);
+    segment_unlink(mailbox_ptr, channel_name(mailbox_ptr, "/shm_lanes", segment));
+}
+
+static void lanes_transport_stats(const mailbox_t *mailbox_ptr, int role)
+{
+    const lane_state_t *state = &mailbox_ptr->lanes;
+
+    transport_stats(mailbox_ptr, role);
+    if (role != ROLE_RECEIVER)
+        return;
+    printf("Frames per lane, most urgent first:");
+    for (int p = PRIORITY_LEVELS - 1; p >= 0; --p)
+        printf(" %llu", (unsigned long long)state->frames[p]);
+    printf(", %llu taken ahead of more urgent ones to avoid starvation\n", (unsigned long long)state->rescued);
+}
+
+const transport_t transport_lanes = {
+    .id = 11,
+    .name = "lanes",
+    .label = "Share Memory Priority Lanes",
+    .open = lanes_transport_open,
+    .claim = lanes_transport_claim,
+    .send = lanes_transport_send,
+    .recv = lanes_transport_recv,
+    .release = lanes_transport_release,
+    .close = lanes_transport_close,
+    .stats = lanes_transport_stats,
+};
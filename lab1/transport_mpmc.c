@@ -0,0 +1,230 @@
+#include <sched.h>
+#include <errno.h>
+#include <signal.h>
+
+#include "transport.h"
+
+/*
+ * Mechanism 4, the MPMC queue shared by any number of senders and receivers.
+ */
+
+/**
+ * @brief Record this process as one of the queue's, beyond MPMC_MAX_ATTACHED it just goes unrecorded
+ */
+static void mpmc_attach(mpmc_t *mpmc)
+{
+    unsigned int slot = atomic_fetch_add_explicit(&mpmc->attached, 1, memory_order_relaxed);
+
+    if (slot < MPMC_MAX_ATTACHED)
+        mpmc->pids[slot] = getpid();
+}
+
+/**
+ * @brief Whether any process recorded on the queue still runs
+ */
+static int mpmc_alive(mpmc_t *mpmc)
+{
+    unsigned int attached = atomic_load_explicit(&mpmc->attached, memory_order_relaxed);
+
+    for (unsigned int i = 0; i < attached && i < MPMC_MAX_ATTACHED; ++i)
+        if (kill(mpmc->pids[i], 0) == 0 || errno == EPERM)
+            return 1;
+    return 0;
+}
+
+static int mpmc_transport_open(mailbox_t *mailbox_ptr, int role)
+{
+    char segment[NAME_MAX];
+    mpmc_t *mpmc;
+
+    mailbox_ptr->sem_send = NULL;
+    mailbox_ptr->sem_receive = NULL;
+
+    if (role == ROLE_RECEIVER) {
+        // Set up by the first sender
+        mpmc = segment_attach(mailbox_ptr, channel_name(mailbox_ptr, "/shm_mpmc", segment), sizeof(mpmc_t), "queue is not set up, start a sender first");
+        if (mpmc == NULL)
+            return -1;
+        while (atomic_load_explicit(&mpmc->state, memory_order_acquire) != MPMC_READY)
+            sched_yield();
+        mpmc_attach(mpmc);
+        if (mailbox_ptr->spin_budget == SPIN_BUDGET_UNSET)
+            mailbox_ptr->spin_budget = DEFAULT_SPIN_BUDGET;
+        mailbox_ptr->storage.mpmc = mpmc;
+        return 0;
+    }
+
+    // The first of the senders sets the queue up, sizing an already sized segment again leaves its contents alone
+    mpmc = segment_create(mailbox_ptr, channel_name(mailbox_ptr, "/shm_mpmc", segment), sizeof(mpmc_t), 0);
+    if (mpmc == NULL)
+        return -1;
+
+    for (;;) {
+        unsigned int state = atomic_load_explicit(&mpmc->state, memory_order_acquire);
+        // A queue whose senders all finished is left over from an earlier run
+        int finished = state == MPMC_READY &&
+                       atomic_load_explicit(&mpmc->finished, memory_order_acquire) == mpmc->producers;
+        // So is one every sender and receiver of has gone away without finishing, a killed run
+        int abandoned = state == MPMC_READY && !finished && !mpmc_alive(mpmc);
+        int stale = abandoned || (finished &&
+                    atomic_load_explicit(&mpmc->dequeue_pos, memory_order_acquire) ==
+                    atomic_load_explicit(&mpmc->enqueue_pos, memory_order_acquire));
+
+        if (finished && !stale) {
+            fprintf(stderr, "shm_mpmc: queue still holds an earlier run, start its receivers first\n");
+            return -1;
+        }
+
+        if ((state == MPMC_FREE || stale) &&
+            atomic_compare_exchange_strong(&mpmc->state, &state, MPMC_INIT)) {
+            if (abandoned)
+                fprintf(stderr, "shm_mpmc: queue left by a run that was killed, setting it up again\n");
+            mpmc->capacity = MPMC_SLOTS;
+            mpmc->producers = mailbox_ptr->producers;
+            atomic_store(&mpmc->finished, 0);
+            atomic_store(&mpmc->attached, 0);
+            mpmc_attach(mpmc);
+            atomic_store(&mpmc->enqueue_pos, 0);
+            atomic_store(&mpmc->dequeue_pos, 0);
+            for (unsigned long i = 0; i < MPMC_SLOTS; ++i)
+                atomic_store_explicit(&mpmc->cells[i].seq, i, memory_order_relaxed);
+            atomic_store_explicit(&mpmc->state, MPMC_READY, memory_order_release);
+            break;
+        }
+        if (state == MPMC_READY && !stale) {
+            mpmc_attach(mpmc);
+            break;
+        }
+        sched_yield();
+    }
+    if (mpmc->producers != mailbox_ptr->producers) {
+        fprintf(stderr, "shm_mpmc: queue was set up for %u senders, not %u\n", mpmc->producers, mailbox_ptr->producers);
+        return -1;
+    }
+    mailbox_ptr->storage.mpmc = mpmc;
+    return 0;
+}
+
+static int mpmc_transport_send(mailbox_t *mailbox_ptr, frame_t *frame)
+{
+    /*
+        Claim the next free cell of the MPMC queue, copy the frame in and publish it.
+        The exit frame only marks this sender finished, receivers stop once every sender is and the queue is empty.
+    */
+    mpmc_t *mpmc = mailbox_ptr->storage.mpmc;
+    unsigned long pos = atomic_load_explicit(&mpmc->enqueue_pos, memory_order_relaxed);
+    size_t frame_size = FRAME_HEADER_SIZE + frame->length;
+    unsigned int spins = 0;
+    struct timespec start;
+    mpmc_cell_t *cell;
+
+    if (frame->type == MSG_EXIT) {
+        atomic_fetch_add_explicit(&mpmc->finished, 1, memory_order_release);
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;) {
+        cell = &mpmc->cells[pos & (mpmc->capacity - 1)];
+        long diff = (long)(atomic_load_explicit(&cell->seq, memory_order_acquire) - pos);
+        if (diff == 0) {
+            // Our turn for this cell, unless another sender claims it first (the CAS reloads pos)
+            if (atomic_compare_exchange_weak_explicit(&mpmc->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            // Full: the cell still holds last lap's frame
+            if (spins++ < mailbox_ptr->spin_budget) {
+                cpu_relax();
+            } else {
+                // Counted once per wait, not per yield
+                mailbox_ptr->sleeps += spins == mailbox_ptr->spin_budget + 1;
+                sched_yield();
+            }
+            pos = atomic_load_explicit(&mpmc->enqueue_pos, memory_order_relaxed);
+        } else {
+            pos = atomic_load_explicit(&mpmc->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    memcpy(&cell->frame, frame, frame_size);
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    transport_account(mailbox_ptr, &start, frame_size);
+    return 0;
+}
+
+static frame_t* mpmc_transport_recv(mailbox_t *mailbox_ptr)
+{
+    /*
+        Claim the next published cell of the MPMC queue and return its frame in place.
+        Return NULL once every sender has finished and the queue is drained.
+    */
+    mpmc_t *mpmc = mailbox_ptr->storage.mpmc;
+    unsigned long pos = atomic_load_explicit(&mpmc->dequeue_pos, memory_order_relaxed);
+    unsigned int spins = 0;
+    mpmc_cell_t *cell;
+
+    for (;;) {
+        cell = &mpmc->cells[pos & (mpmc->capacity - 1)];
+        long diff = (long)(atomic_load_explicit(&cell->seq, memory_order_acquire) - (pos + 1));
+        if (diff == 0) {
+            // Published, ours unless another receiver claims it first (the CAS reloads pos)
+            if (atomic_compare_exchange_weak_explicit(&mpmc->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            // Empty: done if every sender finished before this cell was found still unpublished
+            if (atomic_load_explicit(&mpmc->finished, memory_order_acquire) == mpmc->producers &&
+                atomic_load_explicit(&cell->seq, memory_order_acquire) != pos + 1)
+                return NULL;
+            if (spins++ < mailbox_ptr->spin_budget) {
+                cpu_relax();
+            } else {
+                // Counted once per wait, not per yield
+                mailbox_ptr->sleeps += spins == mailbox_ptr->spin_budget + 1;
+                sched_yield();
+            }
+            pos = atomic_load_explicit(&mpmc->dequeue_pos, memory_order_relaxed);
+        } else {
+            pos = atomic_load_explicit(&mpmc->dequeue_pos, memory_order_relaxed);
+        }
+    }
+
+    mailbox_ptr->batch.position = pos;
+    mailbox_ptr->frames++;
+    mailbox_ptr->wire_bytes += FRAME_HEADER_SIZE + cell->frame.length;
+    stats_publish(mailbox_ptr);
+    return &cell->frame;
+}
+
+static void mpmc_transport_release(mailbox_t *mailbox_ptr, frame_t *frame)
+{
+    // Free the cell for the sender that claims the same position one lap later
+    mpmc_t *mpmc = mailbox_ptr->storage.mpmc;
+    unsigned long pos = mailbox_ptr->batch.position;
+
+    atomic_store_explicit(&mpmc->cells[pos & (mpmc->capacity - 1)].seq, pos + mpmc->capacity, memory_order_release);
+}
+
+static void mpmc_transport_close(mailbox_t *mailbox_ptr, int role)
+{
+    char segment[NAME_MAX];
+
+    segment_unmap(mailbox_ptr, mailbox_ptr->storage.mpmc);
+    // The receivers remove the queue once it is drained, unlinking while others still drain is fine
+    if (role == ROLE_RECEIVER)
+        segment_unlink(mailbox_ptr, channel_name(mailbox_ptr, "/shm_mpmc", segment));
+}
+
+const transport_t transport_mpmc = {
+    .id = 4,
+    .name = "mpmc",
+    .label = "Share Memory MPMC",
+    .open = mpmc_transport_open,
+    .claim = transport_staging_frame,
+    .send = mpmc_transport_send,
+    .recv = mpmc_transport_recv,
+    .release = mpmc_transport_release,
+    .close = mpmc_transport_close,
+    .stats = transport_stats,
+};
@@ -0,0 +1,188 @@
+#define _GNU_SOURCE    // pipe2 and F_SETPIPE_SZ
+
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/stat.h>
+
+#include "transport.h"
+
+/*
+ * Mechanisms 6 and 7, frames written back to back into a pipe.
+ * Two independently started processes share no parent to inherit an anonymous pipe from,
+ * so for mechanism 6 the sender creates one and hands the read end over a Unix socket,
+ * mechanism 7 meets on a named FIFO instead.
+ */
+
+#define PIPE_SOCKET "lab1/pipe"
+#define FIFO_PATH "/tmp/lab1_fifo"
+#define PIPE_SIZE (1 << 20)    // asked for with F_SETPIPE_SZ, the default is 64 KB
+
+/**
+ * @brief write() all of length bytes, pipes may take less at a time
+ *
+ * @return int
+ * Return 0 on success, -1 on error
+ */
+static int write_full(int fd, const void *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data = (const char *)data + n;
+        length -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief read() exactly length bytes
+ *
+ * @return int
+ * Return 0 on success, -1 on error or if the writer closed before length bytes arrived
+ */
+static int read_full(int fd, void *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t n = read(fd, data, length);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data = (char *)data + n;
+        length -= n;
+    }
+    return 0;
+}
+
+static int pipe_transport_open(mailbox_t *mailbox_ptr, int role)
+{
+    char socket[NAME_MAX];
+    int fds[2];
+
+    mailbox_ptr->sem_send = NULL;
+    mailbox_ptr->sem_receive = NULL;
+
+    if (role == ROLE_RECEIVER) {
+        if (receive_fds(channel_name(mailbox_ptr, PIPE_SOCKET, socket), fds, 1) == -1)
+            return -1;
+        mailbox_ptr->storage.fd = fds[0];
+        return 0;
+    }
+
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        perror("pipe");
+        return -1;
+    }
+    // Larger pipes batch more frames per wake-up, fine to keep the default if refused
+    fcntl(fds[1], F_SETPIPE_SZ, PIPE_SIZE);
+
+    // Waits for the receiver to connect
+    if (send_fds(channel_name(mailbox_ptr, PIPE_SOCKET, socket), fds, 1) == -1)
+        return -1;
+    close(fds[0]);
+    mailbox_ptr->storage.fd = fds[1];
+    return 0;
+}
+
+static int fifo_transport_open(mailbox_t *mailbox_ptr, int role)
+{
+    char buffer[NAME_MAX];
+    const char *path = channel_name(mailbox_ptr, FIFO_PATH, buffer);
+
+    mailbox_ptr->sem_send = NULL;
+    mailbox_ptr->sem_receive = NULL;
+
+    if (role == ROLE_SENDER) {
+        // Replace whatever an earlier run left, then wait for the receiver to open the other end
+        unlink(path);
+        if (mkfifo(path, 0666) == -1) {
+            perror("mkfifo");
+            return -1;
+        }
+        mailbox_ptr->storage.fd = open(path, O_WRONLY | O_CLOEXEC);
+    } else {
+        mailbox_ptr->storage.fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    if (mailbox_ptr->storage.fd == -1) {
+        perror(path);
+        return -1;
+    }
+    if (role == ROLE_SENDER)
+        fcntl(mailbox_ptr->storage.fd, F_SETPIPE_SZ, PIPE_SIZE);
+    return 0;
+}
+
+static int pipe_transport_send(mailbox_t *mailbox_ptr, frame_t *frame)
+{
+    size_t frame_size = FRAME_HEADER_SIZE + frame->length;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    transport_poll(mailbox_ptr, mailbox_ptr->storage.fd, POLLOUT);
+    if (write_full(mailbox_ptr->storage.fd, frame, frame_size) == -1) {
+        perror("write");
+        return -1;
+    }
+    transport_account(mailbox_ptr, &start, frame_size);
+    return 0;
+}
+
+static frame_t* pipe_transport_recv(mailbox_t *mailbox_ptr)
+{
+    // The header says how much of the frame follows
+    frame_t *frame = &mailbox_ptr->batch.frame;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    transport_poll(mailbox_ptr, mailbox_ptr->storage.fd, POLLIN);
+    if (read_full(mailbox_ptr->storage.fd, frame, FRAME_HEADER_SIZE) == -1 ||
+        frame->length > sizeof(frame->data) ||
+        read_full(mailbox_ptr->storage.fd, frame->data, frame->length) == -1) {
+        fprintf(stderr, "%s: sender closed the pipe mid-frame\n", mailbox_ptr->transport->name);
+        return NULL;
+    }
+    transport_account(mailbox_ptr, &start, FRAME_HEADER_SIZE + frame->length);
+    return frame;
+}
+
+static void pipe_transport_close(mailbox_t *mailbox_ptr, int role)
+{
+    close(mailbox_ptr->storage.fd);
+}
+
+static void fifo_transport_close(mailbox_t *mailbox_ptr, int role)
+{
+    char path[NAME_MAX];
+
+    close(mailbox_ptr->storage.fd);
+    unlink(channel_name(mailbox_ptr, FIFO_PATH, path));
+}
+
+const transport_t transport_pipe = {
+    .id = 6,
+    .name = "pipe",
+    .label = "Pipe",
+    .open = pipe_transport_open,
+    .claim = transport_staging_frame,
+    .send = pipe_transport_send,
+    .recv = pipe_transport_recv,
+    .close = pipe_transport_close,
+    .stats = transport_stats,
+};
+
+const transport_t transport_fifo = {
+    .id = 7,
+    .name = "fifo",
+    .label = "Named Pipe",
+    .open = fifo_transport_open,
+    .claim = transport_staging_frame,
+    .send = pipe_transport_send,
+    .recv = pipe_transport_recv,
+    .close = fifo_transport_close,
+    .stats = transport_stats,
+};
@@ -0,0 +1,192 @@
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "transport.h"
+
+/*
+ * Mechanisms 1 and 2, the original POSIX message queue and single-slot shared memory.
+ */
+
+// Absolute timeout long past, mq_timedreceive returns at once instead of blocking
+static const struct timespec mq_now = {0, 0};
+
+static int mq_transport_open(mailbox_t *mailbox_ptr, int role)
+{
+    char buffer[NAME_MAX];
+    const char *name = channel_name(mailbox_ptr, "/msg_queue", buffer);
+
+    if (role == ROLE_SENDER) {
+        // Drop a leftover queue whose message size may differ
+        struct mq_attr attr = {0, mailbox_ptr->queue_depth, sizeof(frame_t), 0};
+
+        mq_unlink(name);
+        mailbox_ptr->storage.mqd = mq_open(name, O_CREAT | O_WRONLY, 0666, &attr);
+    } else {
+        mailbox_ptr->storage.mqd = mq_open(name, O_CREAT | O_RDONLY, 0666, NULL);
+    }
+    if (mailbox_ptr->storage.mqd == (mqd_t)-1) {
+        perror("mq_open");
+        return -1;
+    }
+
+    // "/receiver" counts credits: frames the sender may still put in the queue
+    if (transport_open_semaphores(mailbox_ptr, role, mailbox_ptr->credits) == -1)
+        return -1;
+    if (role == ROLE_SENDER && mailbox_ptr->credits > 1)
+        printf("Pipelined, up to %u frames in flight\n", mailbox_ptr->credits);
+    return 0;
+}
+
+static int mq_transport_send(mailbox_t *mailbox_ptr, frame_t *frame)
+{
+    struct timespec start;
+    int result = 0;
+
+    // Take a credit, the receiver hands it back once the frame is out of the queue
+    transport_sem_wait(mailbox_ptr, mailbox_ptr->sem_receive);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (mq_send(mailbox_ptr->storage.mqd, (char *)frame, FRAME_HEADER_SIZE + frame->length, frame->priority) == -1) {
+        perror("mq_send");
+        result = -1;
+    }
+    transport_account(mailbox_ptr, &start, FRAME_HEADER_SIZE + frame->length);
+    return result;
+}
+
+static frame_t* mq_transport_recv(mailbox_t *mailbox_ptr)
+{
+    frame_t *frame = &mailbox_ptr->batch.frame;
+    struct timespec start;
+
+    // Blocks until a frame is queued, counted as a sleep when the queue was empty
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ssize_t n = mq_timedreceive(mailbox_ptr->storage.mqd, (char *)frame, sizeof(frame_t), NULL, &mq_now);
+    if (n == -1 && errno == ETIMEDOUT) {
+        mailbox_ptr->sleeps++;
+        n = mq_receive(mailbox_ptr->storage.mqd, (char *)frame, sizeof(frame_t), NULL);
+    }
+    if (n == -1) {
+        perror("mq_receive");
+        return NULL;
+    }
+    transport_account(mailbox_ptr, &start, FRAME_HEADER_SIZE + frame->length);
+
+    // Hand the credit back so the sender may queue another frame
+    sem_post(mailbox_ptr->sem_receive);
+    return frame;
+}
+
+static int mq_transport_watch(mailbox_t *mailbox_ptr)
+{
+    // A message queue descriptor polls readable while the queue holds a message
+    return mailbox_ptr->storage.mqd;
+}
+
+static int mq_transport_ready(mailbox_t *mailbox_ptr, int woken)
+{
+    struct mq_attr attr;
+
+    return mq_getattr(mailbox_ptr->storage.mqd, &attr) == 0 && attr.mq_curmsgs > 0;
+}
+
+static void mq_transport_close(mailbox_t *mailbox_ptr, int role)
+{
+    char name[NAME_MAX];
+
+    mq_close(mailbox_ptr->storage.mqd);
+    mq_unlink(channel_name(mailbox_ptr, "/msg_queue", name));
+    transport_close_semaphores(mailbox_ptr);
+}
+
+const transport_t transport_mq = {
+    .id = 1,
+    .name = "mq",
+    .label = "Message Passing",
+    .open = mq_transport_open,
+    .claim = transport_staging_frame,
+    .send = mq_transport_send,
+    .recv = mq_transport_recv,
+    .watch = mq_transport_watch,
+    .ready = mq_transport_ready,
+    .close = mq_transport_close,
+    .stats = transport_stats,
+};
+
+static int shm_transport_open(mailbox_t *mailbox_ptr, int role)
+{
+    char name[NAME_MAX];
+    int shm_fd;
+
+    if (role == ROLE_SENDER)
+        shm_fd = shm_open(channel_name(mailbox_ptr, "/shm_memory", name), O_CREAT | O_RDWR, 0666);
+    else
+        shm_fd = shm_open(channel_name(mailbox_ptr, "/shm_memory", name), O_CREAT | O_RDONLY, 0666);
+    if (shm_fd == -1) {
+        perror("shm_open");
+        return -1;
+    }
+    if (transport_open_semaphores(mailbox_ptr, role, 0) == -1)
+        return -1;
+
+    if (role == ROLE_SENDER && ftruncate(shm_fd, sizeof(frame_t)) == -1) {
+        perror("shm_ftruncate");
+        return -1;
+    }
+    mailbox_ptr->storage.shm_addr = mmap(NULL, sizeof(frame_t), role == ROLE_SENDER ? PROT_WRITE : PROT_READ,
+                                         MAP_SHARED, shm_fd, 0);
+    close(shm_fd);
+    if (mailbox_ptr->storage.shm_addr == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    return 0;
+}
+
+static int shm_transport_send(mailbox_t *mailbox_ptr, frame_t *frame)
+{
+    struct timespec start;
+
+    // Wait for the receiver's turn, then hand it the slot
+    transport_sem_wait(mailbox_ptr, mailbox_ptr->sem_receive);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memcpy(mailbox_ptr->storage.shm_addr, frame, FRAME_HEADER_SIZE + frame->length);
+    transport_account(mailbox_ptr, &start, FRAME_HEADER_SIZE + frame->length);
+    sem_post(mailbox_ptr->sem_send);
+    return 0;
+}
+
+static frame_t* shm_transport_recv(mailbox_t *mailbox_ptr)
+{
+    frame_t *frame = &mailbox_ptr->batch.frame;
+    struct timespec start;
+
+    sem_post(mailbox_ptr->sem_receive);
+    transport_sem_wait(mailbox_ptr, mailbox_ptr->sem_send);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memcpy(frame, mailbox_ptr->storage.shm_addr, FRAME_HEADER_SIZE + ((frame_t *)mailbox_ptr->storage.shm_addr)->length);
+    transport_account(mailbox_ptr, &start, FRAME_HEADER_SIZE + frame->length);
+    return frame;
+}
+
+static void shm_transport_close(mailbox_t *mailbox_ptr, int role)
+{
+    char name[NAME_MAX];
+
+    munmap(mailbox_ptr->storage.shm_addr, sizeof(frame_t));
+    shm_unlink(channel_name(mailbox_ptr, "/shm_memory", name));
+    transport_close_semaphores(mailbox_ptr);
+}
+
+const transport_t transport_shm = {
+    .id = 2,
+    .name = "shm",
+    .label = "Share Memory",
+    .open = shm_transport_open,
+    .claim = transport_staging_frame,
+    .send = shm_transport_send,
+    .recv = shm_transport_recv,
+    .close = shm_transport_close,
+    .stats = transport_stats,
+};
@@ -0,0 +1,265 @@
+#include <sys/eventfd.h>
+
+#include "transport.h"
+
+/*
+ * Mechanism 3, the SPSC ring filled in place, and mechanism 9, the same ring with eventfd wake-ups.
+ * The eventfds cannot be opened by name, the sender hands them to the receiver over a Unix socket.
+ */
+
+#define EVENTFD_SOCKET "lab1/eventfd"
+#define NOTIFY_DATA 0      // notify[]: the receiver blocks on it while the ring is empty
+#define NOTIFY_SPACE 1     // notify[]: the sender blocks on it while the ring is full
+
+/*
+ * wait_while_equal() for WAIT_EVENTFD: same waiting flag protocol, but the sleep is a read of fd.
+ * The eventfd counter keeps a wake-up that lands before the read, so none is lost.
+ */
+static unsigned int wait_eventfd(atomic_ulong *counter, unsigned long value, waitpoint_t *wp,
+                                 int fd, unsigned int spin_budget)
+{
+    unsigned int spins = 0, sleeps = 0;
+    uint64_t count;
+
+    while (atomic_load_explicit(counter, memory_order_acquire) == value) {
+        if (spins < spin_budget) {
+            spins++;
+            cpu_relax();
+            continue;
+        }
+
+        atomic_store_explicit(&wp->waiting, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(counter, memory_order_acquire) == value) {
+            if (read(fd, &count, sizeof(count)) == -1)
+                perror("read eventfd");
+            sleeps++;
+        }
+        atomic_store_explicit(&wp->waiting, 0, memory_order_relaxed);
+    }
+    return sleeps;
+}
+
+static void ring_wait(mailbox_t *mailbox_ptr, atomic_ulong *counter, unsigned long value, waitpoint_t *wp, int notify)
+{
+    if (mailbox_ptr->wait_strategy == WAIT_EVENTFD)
+        mailbox_ptr->sleeps += wait_eventfd(counter, value, wp, mailbox_ptr->notify[notify], mailbox_ptr->spin_budget);
+    else
+        mailbox_ptr->sleeps += wait_while_equal(counter, value, wp, mailbox_ptr->wait_strategy, mailbox_ptr->spin_budget);
+}
+
+static void ring_wake(mailbox_t *mailbox_ptr, waitpoint_t *wp, int notify)
+{
+    uint64_t one = 1;
+
+    if (mailbox_ptr->wait_strategy == WAIT_FUTEX) {
+        waitpoint_wake(wp);
+    } else if (mailbox_ptr->wait_strategy == WAIT_EVENTFD) {
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&wp->waiting, memory_order_relaxed) &&
+            write(mailbox_ptr->notify[notify], &one, sizeof(one)) == -1)
+            perror("write eventfd");
+    }
+}
+
+static int ring_transport_open(mailbox_t *mailbox_ptr, int role)
+{
+    char segment[NAME_MAX], socket[NAME_MAX];
+    ring_t *ring;
+
+    // No per-message semaphores, the sender creates and initializes the ring, wiping one left over from an earlier run
+    if (role == ROLE_SENDER)
+        ring = segment_create(mailbox_ptr, channel_name(mailbox_ptr, "/shm_memory", segment), sizeof(ring_t), 1);
+    else
+        ring = segment_attach(mailbox_ptr, channel_name(mailbox_ptr, "/shm_memory", segment), sizeof(ring_t),
+                              "ring is not set up, start the sender first");
+    if (ring == NULL)
+        return -1;
+    mailbox_ptr->storage.ring = ring;
+    mailbox_ptr->sem_send = NULL;
+    mailbox_ptr->sem_receive = NULL;
+
+    if (role == ROLE_SENDER) {
+        ring->capacity = RING_SLOTS;
+        ring->wait_strategy = mailbox_ptr->wait_strategy;
+        ring->spin_budget = mailbox_ptr->spin_budget;
+
+        // Count published and free slots, starting from an empty ring
+        if (mailbox_ptr->wait_strategy == WAIT_SEM &&
+            transport_open_semaphores(mailbox_ptr, role, RING_SLOTS) == -1)
+            return -1;
+        if (mailbox_ptr->wait_strategy == WAIT_EVENTFD) {
+            mailbox_ptr->notify[NOTIFY_DATA] = eventfd(0, EFD_CLOEXEC);
+            mailbox_ptr->notify[NOTIFY_SPACE] = eventfd(0, EFD_CLOEXEC);
+            if (mailbox_ptr->notify[NOTIFY_DATA] == -1 || mailbox_ptr->notify[NOTIFY_SPACE] == -1) {
+                perror("eventfd");
+                return -1;
+            }
+        }
+        atomic_store_explicit(&ring->magic, RING_MAGIC, memory_order_release);
+
+        // The ring is visible now, the receiver finds it before asking for the eventfds
+        if (mailbox_ptr->wait_strategy == WAIT_EVENTFD && send_fds(channel_name(mailbox_ptr, EVENTFD_SOCKET, socket), mailbox_ptr->notify, 2) == -1)
+            return -1;
+        return 0;
+    }
+
+    if (atomic_load_explicit(&ring->magic, memory_order_acquire) != RING_MAGIC) {
+        fprintf(stderr, "shm_memory: ring is not set up, start the sender first\n");
+        return -1;
+    }
+
+    // The sender picks the wait strategy, both sides have to agree on it
+    mailbox_ptr->wait_strategy = ring->wait_strategy;
+    if (mailbox_ptr->spin_budget == SPIN_BUDGET_UNSET)
+        mailbox_ptr->spin_budget = ring->spin_budget;
+    if (mailbox_ptr->wait_strategy == WAIT_SEM)
+        return transport_open_semaphores(mailbox_ptr, role, 0);
+    if (mailbox_ptr->wait_strategy == WAIT_EVENTFD)
+        return receive_fds(channel_name(mailbox_ptr, EVENTFD_SOCKET, socket), mailbox_ptr->notify, 2);
+    return 0;
+}
+
+static int eventfd_transport_open(mailbox_t *mailbox_ptr, int role)
+{
+    if (role == ROLE_SENDER)
+        mailbox_ptr->wait_strategy = WAIT_EVENTFD;
+    return ring_transport_open(mailbox_ptr, role);
+}
+
+static frame_t* ring_transport_claim(mailbox_t *mailbox_ptr)
+{
+    // The ring is filled in place, so wait for the slot before anything is written to it
+    ring_t *ring = mailbox_ptr->storage.ring;
+    unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    if (mailbox_ptr->wait_strategy == WAIT_SEM)
+        transport_sem_wait(mailbox_ptr, mailbox_ptr->sem_receive);
+    else
+        ring_wait(mailbox_ptr, &ring->tail, head - ring->capacity, &ring->space, NOTIFY_SPACE);
+    return &ring->slots[head & (ring->capacity - 1)];
+}
+
+static int ring_transport_send(mailbox_t *mailbox_ptr, frame_t *frame)
+{
+    // The records are already in the slot, publishing it is all that is left
+    ring_t *ring = mailbox_ptr->storage.ring;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    atomic_fetch_add_explicit(&ring->head, 1, memory_order_release);
+    ring_wake(mailbox_ptr, &ring->data, NOTIFY_DATA);
+    transport_account(mailbox_ptr, &start, FRAME_HEADER_SIZE + frame->length);
+
+    if (mailbox_ptr->wait_strategy == WAIT_SEM)
+        sem_post(mailbox_ptr->sem_send);
+    return 0;
+}
+
+static frame_t* ring_transport_recv(mailbox_t *mailbox_ptr)
+{
+    // Only wait when the sender has not published anything new, then read in place
+    ring_t *ring = mailbox_ptr->storage.ring;
+    unsigned long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    if (mailbox_ptr->wait_strategy == WAIT_SEM)
+        transport_sem_wait(mailbox_ptr, mailbox_ptr->sem_send);
+    else
+        ring_wait(mailbox_ptr, &ring->head, tail, &ring->data, NOTIFY_DATA);
+    return &ring->slots[tail & (ring->capacity - 1)];
+}
+
+static void ring_transport_release(mailbox_t *mailbox_ptr, frame_t *frame)
+{
+    // Hand the slot back to the sender
+    ring_t *ring = mailbox_ptr->storage.ring;
+    size_t frame_size = FRAME_HEADER_SIZE + frame->length;   // the slot is the sender's again after the add
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    atomic_fetch_add_explicit(&ring->tail, 1, memory_order_release);
+    ring_wake(mailbox_ptr, &ring->space, NOTIFY_SPACE);
+    transport_account(mailbox_ptr, &start, frame_size);
+
+    if (mailbox_ptr->wait_strategy == WAIT_SEM)
+        sem_post(mailbox_ptr->sem_receive);
+}
+
+static int ring_transport_watch(mailbox_t *mailbox_ptr)
+{
+    // Only the eventfd can be polled. Staying announced makes the sender signal every frame,
+    // so nothing published after the eventfd was last read goes unnoticed.
+    if (mailbox_ptr->wait_strategy != WAIT_EVENTFD)
+        return -1;
+    atomic_store_explicit(&mailbox_ptr->storage.ring->data.waiting, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    return mailbox_ptr->notify[NOTIFY_DATA];
+}
+
+static int ring_transport_ready(mailbox_t *mailbox_ptr, int woken)
+{
+    ring_t *ring = mailbox_ptr->storage.ring;
+    uint64_t count;
+
+    if (woken && read(mailbox_ptr->notify[NOTIFY_DATA], &count, sizeof(count)) == -1)
+        perror("read eventfd");
+    return atomic_load_explicit(&ring->head, memory_order_acquire) !=
+           atomic_load_explicit(&ring->tail, memory_order_relaxed);
+}
+
+static void ring_transport_close(mailbox_t *mailbox_ptr, int role)
+{
+    ring_t *ring = mailbox_ptr->storage.ring;
+    char segment[NAME_MAX];
+
+    // Keep the segment alive until the receiver has drained the exit message, sleeping like a full ring does
+    if (role == ROLE_SENDER) {
+        unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed), tail;
+
+        if (mailbox_ptr->wait_strategy == WAIT_SEM)
+            for (unsigned int i = 0; i < ring->capacity; ++i)
+                transport_sem_wait(mailbox_ptr, mailbox_ptr->sem_receive);   // every slot free again
+        else
+            while ((tail = atomic_load_explicit(&ring->tail, memory_order_acquire)) != head)
+                ring_wait(mailbox_ptr, &ring->tail, tail, &ring->space, NOTIFY_SPACE);
+    }
+
+    if (mailbox_ptr->wait_strategy == WAIT_SEM)
+        transport_close_semaphores(mailbox_ptr);
+    if (mailbox_ptr->wait_strategy == WAIT_EVENTFD) {
+        close(mailbox_ptr->notify[NOTIFY_DATA]);
+        close(mailbox_ptr->notify[NOTIFY_SPACE]);
+    }
+    segment_unmap(mailbox_ptr, ring);
+    segment_unlink(mailbox_ptr, channel_name(mailbox_ptr, "/shm_memory", segment));
+}
+
+const transport_t transport_ring = {
+    .id = 3,
+    .name = "ring",
+    .label = "Share Memory Ring",
+    .open = ring_transport_open,
+    .claim = ring_transport_claim,
+    .send = ring_transport_send,
+    .recv = ring_transport_recv,
+    .release = ring_transport_release,
+    .watch = ring_transport_watch,
+    .ready = ring_transport_ready,
+    .close = ring_transport_close,
+    .stats = transport_stats,
+};
+
+const transport_t transport_eventfd = {
+    .id = 9,
+    .name = "eventfd",
+    .label = "Share Memory Ring with eventfd",
+    .open = eventfd_transport_open,
+    .claim = ring_transport_claim,
+    .send = ring_transport_send,
+    .recv = ring_transport_recv,
+    .release = ring_transport_release,
+    .watch = ring_transport_watch,
+    .ready = ring_transport_ready,
+    .close = ring_transport_close,
+    .stats = transport_stats,
+};
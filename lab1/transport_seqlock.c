@@ -0,0 +1,154 @@
+#include <sched.h>
+
+#include "transport.h"
+
+/*
+ * Mechanism 12, latest value wins: one writer overwrites a single seqlock-protected frame,
+ * any number of readers copy out whichever value is newest when they look.
+ * Readers that fall behind skip values instead of slowing the writer down, nothing is queued.
+ */
+
+static int seqlock_transport_open(mailbox_t *mailbox_ptr, int role)
+{
+    char segment[NAME_MAX];
+    latest_t *latest;
+
+    mailbox_ptr->sem_send = NULL;
+    mailbox_ptr->sem_receive = NULL;
+
+    if (role == ROLE_SENDER)
+        latest = segment_create(mailbox_ptr, channel_name(mailbox_ptr, "/shm_latest", segment), sizeof(latest_t), 1);
+    else
+        latest = segment_attach(mailbox_ptr, channel_name(mailbox_ptr, "/shm_latest", segment), sizeof(latest_t),
+                                "no value is published, start the sender first");
+    if (latest == NULL)
+        return -1;
+    mailbox_ptr->storage.latest = latest;
+
+    if (role == ROLE_SENDER) {
+        atomic_store_explicit(&latest->magic, RING_MAGIC, memory_order_release);
+        return 0;
+    }
+
+    if (atomic_load_explicit(&latest->magic, memory_order_acquire) != RING_MAGIC) {
+        fprintf(stderr, "shm_latest: no value is published, start the sender first\n");
+        return -1;
+    }
+    atomic_fetch_add_explicit(&latest->readers, 1, memory_order_relaxed);
+    if (mailbox_ptr->spin_budget == SPIN_BUDGET_UNSET)
+        mailbox_ptr->spin_budget = DEFAULT_SPIN_BUDGET;
+    return 0;
+}
+
+static int seqlock_transport_send(mailbox_t *mailbox_ptr, frame_t *frame)
+{
+    /*
+        Overwrite the value between an odd and the next even seq, readers retry any copy that overlaps.
+        The exit frame leaves the last value in place for readers that have not read it yet.
+    */
+    latest_t *latest = mailbox_ptr->storage.latest;
+    unsigned long seq = atomic_load_explicit(&latest->seq, memory_order_relaxed);
+    size_t frame_size = FRAME_HEADER_SIZE + frame->length;
+    struct timespec start;
+
+    if (frame->type == MSG_EXIT) {
+        atomic_store_explicit(&latest->closed, 1, memory_order_release);
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    atomic_store_explicit(&latest->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&latest->value, frame, frame_size);
+    atomic_store_explicit(&latest->seq, seq + 2, memory_order_release);
+    transport_account(mailbox_ptr, &start, frame_size);
+    return 0;
+}
+
+static frame_t* seqlock_transport_recv(mailbox_t *mailbox_ptr)
+{
+    /*
+        Copy out the newest value once there is one this reader has not read.
+        Return NULL once the writer has closed and its last value was read.
+    */
+    latest_t *latest = mailbox_ptr->storage.latest;
+    latest_state_t *state = &mailbox_ptr->latest;
+    frame_t *copy = &mailbox_ptr->batch.frame;
+    unsigned int spins = 0;
+    unsigned long seq;
+
+    for (;;) {
+        seq = atomic_load_explicit(&latest->seq, memory_order_acquire);
+        if (seq == state->seen || (seq & 1)) {
+            // Nothing new, or the writer is halfway through a value
+            if (seq == state->seen && atomic_load_explicit(&latest->closed, memory_order_acquire) &&
+                atomic_load_explicit(&latest->seq, memory_order_acquire) == state->seen)
+                return NULL;
+            if (spins++ < mailbox_ptr->spin_budget) {
+                cpu_relax();
+            } else {
+                // Counted once per wait, not per yield
+                mailbox_ptr->sleeps += spins == mailbox_ptr->spin_budget + 1;
+                sched_yield();
+            }
+            continue;
+        }
+
+        // The length may be torn as well, keep the copy inside the frame until seq says it is good
+        memcpy(copy, &latest->value, FRAME_HEADER_SIZE);
+        if (copy->length > sizeof(copy->data))
+            copy->length = sizeof(copy->data);
+        memcpy(copy->data, latest->value.data, copy->length);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&latest->seq, memory_order_relaxed) == seq)
+            break;
+        state->retries++;
+    }
+
+    if (state->seen != 0)
+        state->skipped += (seq - state->seen) / 2 - 1;
+    state->seen = seq;
+    mailbox_ptr->frames++;
+    mailbox_ptr->wire_bytes += FRAME_HEADER_SIZE + copy->length;
+    stats_publish(mailbox_ptr);
+    return copy;
+}
+
+static void seqlock_transport_close(mailbox_t *mailbox_ptr, int role)
+{
+    latest_t *latest = mailbox_ptr->storage.latest;
+    char segment[NAME_MAX];
+    int last = 0;
+
+    // The writer never waits for readers, the last reader to leave once it has closed removes the segment
+    if (role == ROLE_RECEIVER)
+        last = atomic_fetch_sub_explicit(&latest->readers, 1, memory_order_acq_rel) == 1 &&
+               atomic_load_explicit(&latest->closed, memory_order_acquire);
+    segment_unmap(mailbox_ptr, latest);
+    if (last)
+        segment_unlink(mailbox_ptr, channel_name(mailbox_ptr, "/shm_latest", segment));
+}
+
+static void seqlock_transport_stats(const mailbox_t *mailbox_ptr, int role)
+{
+    const latest_state_t *state = &mailbox_ptr->latest;
+
+    transport_stats(mailbox_ptr, role);
+    if (role != ROLE_RECEIVER)
+        return;
+    printf("Latest values: %llu read, %llu overwritten before they were read, %llu torn copies retried\n",
+           (unsigned long long)mailbox_ptr->frames, (unsigned long long)state->skipped,
+           (unsigned long long)state->retries);
+}
+
+const transport_t transport_seqlock = {
+    .id = 12,
+    .name = "seqlock",
+    .label = "Share Memory Latest Value",
+    .open = seqlock_transport_open,
+    .claim = transport_staging_frame,
+    .send = seqlock_transport_send,
+    .recv = seqlock_transport_recv,
+    .close = seqlock_transport_close,
+    .stats = seqlock_transport_stats,
+};
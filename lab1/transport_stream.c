@@ -0,0 +1,192 @@
+#include <fcntl.h>
+
+#include "transport.h"
+
+/*
+ * Mechanism 5, the sender's whole input file streamed through two large chunks.
+ * It moves bytes, not frames, so the message API does not apply.
+ */
+
+static int stream_transport_open(mailbox_t *mailbox_ptr, int role)
+{
+    char segment[NAME_MAX];
+    stream_t *stream;
+
+    mailbox_ptr->sem_send = NULL;
+    mailbox_ptr->sem_receive = NULL;
+
+    // Two large chunks instead of message slots, the sender creates and initializes them
+    if (role == ROLE_SENDER)
+        stream = segment_create(mailbox_ptr, channel_name(mailbox_ptr, "/shm_memory", segment), sizeof(stream_t), 1);
+    else
+        stream = segment_attach(mailbox_ptr, channel_name(mailbox_ptr, "/shm_memory", segment), sizeof(stream_t),
+                                "stream is not set up, start the sender first");
+    if (stream == NULL)
+        return -1;
+    mailbox_ptr->storage.stream = stream;
+
+    if (role == ROLE_SENDER) {
+        stream->spin_budget = mailbox_ptr->spin_budget;
+        atomic_store_explicit(&stream->magic, RING_MAGIC, memory_order_release);
+        return 0;
+    }
+
+    if (atomic_load_explicit(&stream->magic, memory_order_acquire) != RING_MAGIC) {
+        fprintf(stderr, "shm_memory: stream is not set up, start the sender first\n");
+        return -1;
+    }
+    if (mailbox_ptr->spin_budget == SPIN_BUDGET_UNSET)
+        mailbox_ptr->spin_budget = stream->spin_budget;
+    return 0;
+}
+
+static int stream_transport_send_file(mailbox_t *mailbox_ptr, const char *input_file)
+{
+    /*
+        Stream input_file as one payload, reading straight into whichever chunk the receiver is not draining
+    */
+    stream_t *stream = mailbox_ptr->storage.stream;
+    uint64_t sum[2] = {0, 0};
+    struct timespec start, end;
+    int fd = open(input_file, O_RDONLY);
+    int error = 0;
+
+    // Still stream an empty payload so the receiver does not wait forever
+    if (fd == -1) {
+        perror("open");
+        error = 1;
+    }
+
+    mailbox_ptr->first_ns = now_ns();
+    for (unsigned long head = 0; ; ++head) {
+        mailbox_ptr->sleeps += wait_while_equal(&stream->tail, head - STREAM_CHUNKS, &stream->space, WAIT_FUTEX, mailbox_ptr->spin_budget);
+        stream_chunk_t *chunk = &stream->chunks[head % STREAM_CHUNKS];
+        unsigned long length = 0;
+        ssize_t n = 0;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);  // Start time
+        while (fd != -1 && length < STREAM_CHUNK_SIZE && (n = read(fd, chunk->data + length, STREAM_CHUNK_SIZE - length)) > 0)
+            length += n;
+        clock_gettime(CLOCK_MONOTONIC, &end);    // End time
+        time_taken += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+        if (n == -1) {
+            // Still finish the stream so the receiver does not wait forever
+            perror("read");
+            error = 1;
+        }
+
+        // A short chunk means end of file, the checksum goes out with it
+        checksum_update(sum, chunk->data, length);
+        chunk->length = length;
+        chunk->last = length < STREAM_CHUNK_SIZE;
+        if (chunk->last)
+            stream->checksum = checksum_final(sum);
+        atomic_store_explicit(&stream->head, head + 1, memory_order_release);
+        waitpoint_wake(&stream->data);
+
+        mailbox_ptr->messages++;
+        mailbox_ptr->bytes += length;
+        mailbox_ptr->frames++;
+        mailbox_ptr->wire_bytes += length;
+        stats_publish(mailbox_ptr);
+        if (chunk->last)
+            break;
+    }
+
+    if (fd != -1)
+        close(fd);
+    printf("Checksum: %016llx\n", (unsigned long long)checksum_final(sum));
+    return error ? -1 : 0;
+}
+
+static int stream_transport_recv_file(mailbox_t *mailbox_ptr, const char *output_file)
+{
+    /*
+        Drain the streamed payload chunk by chunk, writing it to output_file if given, and verify its checksum
+    */
+    stream_t *stream = mailbox_ptr->storage.stream;
+    uint64_t sum[2] = {0, 0};
+    struct timespec start, end;
+    int fd = -1;
+    int error = 0;
+
+    if (output_file != NULL) {
+        fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd == -1) {
+            perror("open");
+            return -1;
+        }
+    }
+
+    for (unsigned long tail = 0; ; ++tail) {
+        mailbox_ptr->sleeps += wait_while_equal(&stream->head, tail, &stream->data, WAIT_FUTEX, mailbox_ptr->spin_budget);
+        stream_chunk_t *chunk = &stream->chunks[tail % STREAM_CHUNKS];
+        unsigned long length = chunk->length;
+        unsigned int last = chunk->last;
+
+        if (mailbox_ptr->messages == 0)
+            mailbox_ptr->first_ns = now_ns();
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        checksum_update(sum, chunk->data, length);
+        for (unsigned long done = 0; fd != -1 && done < length; ) {
+            ssize_t n = write(fd, chunk->data + done, length - done);
+            if (n == -1) {
+                perror("write");
+                close(fd);
+                fd = -1;
+                error = 1;
+                break;
+            }
+            done += n;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        time_taken += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+        // The sender wrote the checksum before publishing the last chunk, read it before handing the chunk back
+        uint64_t expected = stream->checksum;
+        atomic_store_explicit(&stream->tail, tail + 1, memory_order_release);
+        waitpoint_wake(&stream->space);
+
+        mailbox_ptr->messages++;
+        mailbox_ptr->bytes += length;
+        mailbox_ptr->frames++;
+        mailbox_ptr->wire_bytes += length;
+        stats_publish(mailbox_ptr);
+        if (last) {
+            int ok = checksum_final(sum) == expected;
+            printf("Checksum: %016llx %s\n", (unsigned long long)checksum_final(sum), ok ? "OK" : "MISMATCH");
+            if (fd != -1)
+                close(fd);
+            return ok && !error ? 0 : -1;
+        }
+    }
+}
+
+static void stream_transport_close(mailbox_t *mailbox_ptr, int role)
+{
+    stream_t *stream = mailbox_ptr->storage.stream;
+    char segment[NAME_MAX];
+
+    // Keep the segment alive until the receiver has drained the last chunk, asleep on space like a full stream
+    if (role == ROLE_SENDER) {
+        unsigned long head = atomic_load_explicit(&stream->head, memory_order_relaxed), tail;
+
+        while ((tail = atomic_load_explicit(&stream->tail, memory_order_acquire)) != head)
+            mailbox_ptr->sleeps += wait_while_equal(&stream->tail, tail, &stream->space, WAIT_FUTEX,
+                                                    mailbox_ptr->spin_budget);
+    }
+    segment_unmap(mailbox_ptr, stream);
+    segment_unlink(mailbox_ptr, channel_name(mailbox_ptr, "/shm_memory", segment));
+}
+
+const transport_t transport_stream = {
+    .id = 5,
+    .name = "stream",
+    .label = "Share Memory Stream",
+    .open = stream_transport_open,
+    .send_file = stream_transport_send_file,
+    .recv_file = stream_transport_recv_file,
+    .close = stream_transport_close,
+    .stats = transport_stats,
+};